@@ -0,0 +1,123 @@
+#include "BlockCache.h"
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+#include "include/fmt/core.h"
+
+BlockCache::BlockCache(Stat &stat, const Clock &clock, uint64_t capacity,
+                       uint32_t regionSize, EvictionPolicy policy)
+    : stat(stat), clock(clock), regionSize(regionSize), policy(policy),
+      regions(capacity / regionSize) {
+  if (regions.size() < 2) {
+    throw std::runtime_error(
+        "Large object cache needs room for at least two regions");
+  }
+  for (uint32_t i = regions.size(); i-- > 0;) {
+    cleanRegions.push_back(i);
+  }
+  activeRegion = allocateRegion();
+
+  std::cout << fmt::format("Large object cache: {} regions of {:.2f} MB, {} "
+                           "region eviction",
+                           regions.size(),
+                           static_cast<double>(regionSize) / (1024 * 1024),
+                           policy == EvictionPolicy::kLru ? "LRU" : "FIFO")
+            << std::endl;
+}
+
+uint32_t BlockCache::allocateRegion() {
+  if (cleanRegions.empty()) {
+    assert(!evictionOrder.empty());
+    evictRegion(evictionOrder.front());
+  }
+  uint32_t regionId = cleanRegions.back();
+  cleanRegions.pop_back();
+  return regionId;
+}
+
+void BlockCache::evictRegion(uint32_t regionId) {
+  auto &region = regions[regionId];
+  stat.numLargeRegionEvictions++;
+  for (const auto &key : region.keys) {
+    if (auto it = index.find(key);
+        it != std::end(index) && it->second.regionId == regionId) {
+      index.erase(it);
+    }
+  }
+  region.keys.clear();
+  region.usedBytes = 0;
+  evictionOrder.erase(region.evictionPos);
+  cleanRegions.push_back(regionId);
+}
+
+void BlockCache::insert(const DRAMCache::Item &dramItem) {
+  const uint32_t itemSize = dramItem.size + kMetadataSize;
+  if (itemSize > regionSize) {
+    stat.numLargeRejected++;
+    return;
+  }
+
+  remove(dramItem.key);
+
+  if (regions[activeRegion].usedBytes + itemSize > regionSize) {
+    auto &sealed = regions[activeRegion];
+    sealed.evictionPos =
+        evictionOrder.insert(std::end(evictionOrder), activeRegion);
+    activeRegion = allocateRegion();
+  }
+
+  auto &region = regions[activeRegion];
+  region.usedBytes += itemSize;
+  region.keys.push_back(dramItem.key);
+  index[dramItem.key] = {.regionId = activeRegion,
+                         .size = dramItem.size,
+                         .expiryTime = dramItem.expiryTime};
+
+  stat.numLargeWrites++;
+  stat.largeWriteBytes += itemSize;
+}
+
+std::optional<BlockCache::Item> BlockCache::lookup(const std::string &key) {
+  stat.numLargeAccesses++;
+
+  auto it = index.find(key);
+  if (it == std::end(index)) {
+    return std::nullopt;
+  }
+  if (clock.isExpired(it->second.expiryTime)) {
+    stat.numLargeExpired++;
+    stat.largeExpiredBytes += it->second.size;
+    index.erase(it);
+    return std::nullopt;
+  }
+
+  stat.numLargeHits++;
+  const uint32_t regionId = it->second.regionId;
+  if (policy == EvictionPolicy::kLru && regionId != activeRegion) {
+    evictionOrder.splice(std::end(evictionOrder), evictionOrder,
+                         regions[regionId].evictionPos);
+  }
+  return it->second;
+}
+
+bool BlockCache::remove(const std::string &key) {
+  if (auto it = index.find(key); it != std::end(index)) {
+    index.erase(it);
+    return true;
+  }
+  return false;
+}
+
+void BlockCache::appendMemoryUsage(std::vector<MemoryUsage> &usage) const {
+  addTableUsage(usage.emplace_back(MemoryUsage{.table = "large.index"}),
+                index);
+  // Each region lists the keys written to it until it is evicted.
+  auto &keys = usage.emplace_back(MemoryUsage{.table = "large.region-keys"});
+  for (const auto &region : regions) {
+    keys.reservedBytes += region.keys.capacity() * sizeof(std::string);
+    keys.usedBytes += region.keys.size() * sizeof(std::string);
+    keys.numEntries += region.keys.size();
+  }
+}
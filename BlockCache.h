@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Clock.h"
+#include "DRAMCache.h"
+#include "MemoryResource.h"
+#include "include/robin_hood.h"
+#include "stat.h"
+
+// Flash engine for objects above the small-object size threshold. Space is
+// managed in large regions: items are appended to the open region, and when
+// no clean region is left a whole region is evicted, chosen in FIFO order
+// of sealing or by least recent access to any of its items.
+class BlockCache {
+public:
+  static constexpr uint32_t kMetadataSize = 20;
+
+  enum class EvictionPolicy { kFifo, kLru };
+
+  struct Item {
+    uint32_t regionId;
+    uint32_t size;
+    uint32_t expiryTime;
+  };
+
+  BlockCache(Stat &stat, const Clock &clock, uint64_t capacity,
+             uint32_t regionSize, EvictionPolicy policy);
+
+  void insert(const DRAMCache::Item &dramItem);
+
+  std::optional<Item> lookup(const std::string &key);
+
+  // Returns true if a live copy of key was dropped.
+  bool remove(const std::string &key);
+
+  uint32_t getRegionSize() const { return regionSize; }
+
+  void appendMemoryUsage(std::vector<MemoryUsage> &usage) const;
+
+private:
+  struct Region {
+    uint64_t usedBytes{0};
+    std::vector<std::string> keys;
+    std::list<uint32_t>::iterator evictionPos;
+  };
+
+  Stat &stat;
+  const Clock &clock;
+  const uint32_t regionSize;
+  const EvictionPolicy policy;
+
+  std::vector<Region> regions;
+  std::vector<uint32_t> cleanRegions;
+  uint32_t activeRegion;
+
+  // Sealed regions, front is evicted next.
+  std::list<uint32_t> evictionOrder;
+
+  robin_hood::unordered_map<std::string, Item> index;
+
+  uint32_t allocateRegion();
+  void evictRegion(uint32_t regionId);
+};
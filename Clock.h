@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Simulated time shared by the simulator and its tiers. Driven either by
+// trace timestamps or by a configured request rate, relative to the first
+// request. Expiry times are kept in whole seconds, 0 meaning "never".
+struct Clock {
+  uint64_t nowNs{0};
+
+  uint32_t nowSec() const { return static_cast<uint32_t>(nowNs / 1'000'000'000); }
+
+  uint32_t expiryTimeFor(uint32_t ttl) const {
+    return ttl == 0 ? 0 : nowSec() + ttl;
+  }
+
+  bool isExpired(uint32_t expiryTime) const {
+    return expiryTime != 0 && expiryTime <= nowSec();
+  }
+};
@@ -1,44 +1,82 @@
 #include "DRAMCache.h"
+#include "Profile.h"
 #include "Trace.h"
 
+void DRAMCache::erase(decltype(keyToLru)::iterator it) {
+  freeCapacity += it->second->size;
+  lru.erase(it->second);
+  keyToLru.erase(it);
+}
+
 void DRAMCache::remove(const std::string &key) {
   if (auto it = keyToLru.find(key); it != std::end(keyToLru)) {
     assert(it->second->key == key);
-    lru.erase(it->second);
-    keyToLru.erase(it);
+    erase(it);
+  }
+}
 
-    freeCapacity += it->second->size;
+bool DRAMCache::bypass(const std::string &key, uint32_t size, bool isInFifo,
+                       uint32_t expiryTime, VictimSink onVictim) {
+  if (size <= getCapacity()) {
+    return false;
   }
+  onVictim({.key = key,
+            .size = size,
+            .numAccesses = 0,
+            .isInFifo = isInFifo,
+            .expiryTime = expiryTime});
+  return true;
 }
 
-std::vector<DRAMCache::Item> DRAMCache::insert(const std::string &key,
-                                               uint32_t size, bool isInFifo) {
-  std::vector<DRAMCache::Item> victims;
+void DRAMCache::insert(const std::string &key, uint32_t size, bool isInFifo,
+                       uint32_t expiryTime, VictimSink onVictim) {
+  PROFILE_SCOPE(kDramInsert);
+  if (bypass(key, size, isInFifo, expiryTime, onVictim)) {
+    return;
+  }
+  uint64_t numVictims = 0;
   while (freeCapacity < size) {
     const auto &victim = lru.back();
-    victims.push_back(victim);
+    onVictim(victim);
+    numVictims++;
 
     freeCapacity += victim.size;
     keyToLru.erase(victim.key);
     lru.pop_back();
   }
 
-  lru.push_front(
-      {.key = key, .size = size, .numAccesses = 0, .isInFifo = isInFifo});
+  lru.push_front({.key = key,
+                  .size = size,
+                  .numAccesses = 0,
+                  .isInFifo = isInFifo,
+                  .expiryTime = expiryTime});
   keyToLru[key] = std::begin(lru);
   assert(freeCapacity >= size);
   freeCapacity -= size;
 
-  return victims;
+  if (expiryWheel && expiryTime != 0) {
+    expiryWheel->schedule(key, expiryTime);
+  }
+
+  PROFILE_COUNT(kDramVictims, numVictims);
+  PROFILE_MAX(kMaxDramVictims, numVictims);
 }
 
 std::optional<DRAMCache::Item> DRAMCache::lookup(const std::string &key) {
+  PROFILE_SCOPE(kDramLookup);
   stat.numDramAccesses++;
 
   if (auto it = keyToLru.find(key); it != std::end(keyToLru)) {
+    assert(it->second->key == key);
+    if (clock.isExpired(it->second->expiryTime)) {
+      stat.numDramExpired++;
+      stat.dramExpiredBytes += it->second->size;
+      erase(it);
+      return std::nullopt;
+    }
+
     stat.numDramHits++;
 
-    assert(it->second->key == key);
     lru.splice(std::begin(lru), lru, it->second);
     assert(it->second == std::begin(lru));
     it->second->numAccesses++;
@@ -47,3 +85,57 @@ std::optional<DRAMCache::Item> DRAMCache::lookup(const std::string &key) {
   }
   return std::nullopt;
 }
+
+void DRAMCache::update(const std::string &key, uint32_t size, bool isInFifo,
+                       uint32_t expiryTime, VictimSink onVictim) {
+  auto it = keyToLru.find(key);
+  if (it == std::end(keyToLru)) {
+    insert(key, size, isInFifo, expiryTime, onVictim);
+    return;
+  }
+  if (size > getCapacity()) {
+    erase(it);
+    bypass(key, size, isInFifo, expiryTime, onVictim);
+    return;
+  }
+
+  auto itemIt = it->second;
+  lru.splice(std::begin(lru), lru, itemIt);
+  freeCapacity += itemIt->size;
+  itemIt->size = size;
+  itemIt->isInFifo = isInFifo;
+  itemIt->expiryTime = expiryTime;
+
+  while (freeCapacity < size && std::prev(std::end(lru)) != itemIt) {
+    const auto &victim = lru.back();
+    onVictim(victim);
+
+    freeCapacity += victim.size;
+    keyToLru.erase(victim.key);
+    lru.pop_back();
+  }
+  assert(freeCapacity >= size);
+  freeCapacity -= size;
+
+  if (expiryWheel && expiryTime != 0) {
+    expiryWheel->schedule(key, expiryTime);
+  }
+}
+
+void DRAMCache::expire() {
+  if (!expiryWheel) {
+    return;
+  }
+  expiryWheel->advance(
+      clock.nowSec(), [this](const std::string &key, uint32_t expiryTime) {
+        auto it = keyToLru.find(key);
+        // Stale entry: the item was evicted, removed or re-inserted since.
+        if (it == std::end(keyToLru) ||
+            it->second->expiryTime != expiryTime) {
+          return;
+        }
+        stat.numDramExpired++;
+        stat.dramExpiredBytes += it->second->size;
+        erase(it);
+      });
+}
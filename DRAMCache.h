@@ -1,12 +1,19 @@
 #pragma once
 
+#include "Clock.h"
+#include "FunctionRef.h"
+#include "MemoryResource.h"
+#include "TimerWheel.h"
 #include "include/fmt/core.h"
 #include "include/robin_hood.h"
 #include "stat.h"
 #include <cstdint>
 #include <iostream>
 #include <list>
+#include <memory>
+#include <memory_resource>
 #include <optional>
+#include <vector>
 
 class DRAMCache {
 public:
@@ -15,30 +22,104 @@ public:
     uint32_t size;
     uint32_t numAccesses;
     bool isInFifo;
+    uint32_t expiryTime;
   };
 
-  DRAMCache(Stat &stat, uint64_t capacity)
-      : stat(stat), capacity(capacity), freeCapacity(capacity) {
+  // Receives each evicted item just before it is dropped.
+  using VictimSink = FunctionRef<void(const Item &)>;
+
+  // LRU nodes are allocated from memory.
+  DRAMCache(Stat &stat, const Clock &clock, uint64_t capacity,
+            std::pmr::memory_resource *memory = std::pmr::new_delete_resource())
+      : stat(stat), clock(clock), capacity(capacity), freeCapacity(capacity),
+        lru(memory) {
     std::cout << fmt::format("DRAM size: {:.2f} MB",
                              static_cast<double>(capacity) / std::pow(1024, 2))
               << std::endl;
   }
 
+  // Takes bytes out of the capacity, e.g. for DRAM spent on the flash
+  // index. Call before the first insert.
+  void reserveCapacity(uint64_t bytes) {
+    if (bytes >= freeCapacity) {
+      throw std::runtime_error(
+          fmt::format("Cannot reserve {} bytes of a {} byte DRAM cache", bytes,
+                      freeCapacity));
+    }
+    freeCapacity -= bytes;
+    reservedCapacity += bytes;
+    std::cout << fmt::format("DRAM size: {:.2f} MB after reserving {:.2f} MB",
+                             static_cast<double>(freeCapacity) /
+                                 std::pow(1024, 2),
+                             static_cast<double>(bytes) / std::pow(1024, 2))
+              << std::endl;
+  }
+
   void remove(const std::string &key);
 
-  std::vector<Item> insert(const std::string &key, uint32_t size,
-                           bool isInFifo);
+  // Items larger than the capacity skip DRAM: they go to onVictim as if
+  // evicted right away.
+  void insert(const std::string &key, uint32_t size, bool isInFifo,
+              uint32_t expiryTime, VictimSink onVictim);
 
   std::optional<DRAMCache::Item> lookup(const std::string &key);
 
+  // SET/REPLACE: updates a cached item in place (size included) and makes
+  // it most recently used, or inserts it if absent. Items evicted to make
+  // room for a size increase go to onVictim.
+  void update(const std::string &key, uint32_t size, bool isInFifo,
+              uint32_t expiryTime, VictimSink onVictim);
+
+  // Expired items are otherwise only dropped lazily when they are looked
+  // up; with the wheel enabled, expire() frees their capacity in bulk.
+  void enableProactiveExpiry() { expiryWheel = std::make_unique<TimerWheel>(); }
+
+  void expire();
+
+  // Capacity left for objects, and the bytes of the cached ones.
+  uint64_t getCapacity() const { return capacity - reservedCapacity; }
+  uint64_t getUsedBytes() const { return getCapacity() - freeCapacity; }
+
+  void forEachItem(FunctionRef<void(const Item &)> fn) const {
+    for (const auto &item : lru) {
+      fn(item);
+    }
+  }
+
+  void appendMemoryUsage(std::vector<MemoryUsage> &usage) const {
+    addTableUsage(usage.emplace_back(MemoryUsage{.table = "dram.index"}),
+                  keyToLru);
+    // A list node is two links plus the item.
+    const uint64_t lruBytes = lru.size() * (2 * sizeof(void *) + sizeof(Item));
+    usage.push_back({.table = "dram.lru",
+                     .reservedBytes = lruBytes,
+                     .usedBytes = lruBytes,
+                     .numEntries = lru.size()});
+    if (expiryWheel) {
+      expiryWheel->addMemoryUsage(
+          usage.emplace_back(MemoryUsage{.table = "dram.expiry-wheel"}));
+    }
+  }
+
 private:
   Stat &stat;
+  const Clock &clock;
   const uint64_t capacity;
   uint64_t freeCapacity;
+  uint64_t reservedCapacity{0};
 
   // front: recently accessed items
   // back: least recently used
-  std::list<Item> lru;
+  std::pmr::list<Item> lru;
+
+  robin_hood::unordered_map<std::string, std::pmr::list<Item>::iterator>
+      keyToLru;
+
+  std::unique_ptr<TimerWheel> expiryWheel;
+
+  void erase(decltype(keyToLru)::iterator it);
 
-  robin_hood::unordered_map<std::string, std::list<Item>::iterator> keyToLru;
+  // Hands an item that cannot fit to onVictim; returns false if it fits.
+  bool bypass(const std::string &key, uint32_t size, bool isInFifo,
+              uint32_t expiryTime, VictimSink onVictim);
 };
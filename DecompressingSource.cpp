@@ -0,0 +1,320 @@
+#include "DecompressingSource.h"
+
+#include <array>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <utility>
+
+#include <zlib.h>
+
+#if __has_include(<zstd.h>)
+#define TRACE_HAVE_ZSTD 1
+#include <zstd.h>
+#endif
+
+#if __has_include(<lz4frame.h>)
+#define TRACE_HAVE_LZ4 1
+#include <lz4frame.h>
+#endif
+
+#include "include/fmt/core.h"
+
+Compression detectCompression(const std::filesystem::path &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+  std::array<uint8_t, 4> magic{};
+  ssize_t n = ::read(fd, magic.data(), magic.size());
+  ::close(fd);
+
+  if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return Compression::kGzip;
+  }
+  if (n == 4 && magic == std::array<uint8_t, 4>{0x28, 0xb5, 0x2f, 0xfd}) {
+    return Compression::kZstd;
+  }
+  if (n == 4 && magic == std::array<uint8_t, 4>{0x04, 0x22, 0x4d, 0x18}) {
+    return Compression::kLz4;
+  }
+  return Compression::kNone;
+}
+
+namespace {
+
+class GzipDecoder : public DecompressingSource::Decoder {
+public:
+  GzipDecoder() {
+    // 15 + 32: maximum window, accept both gzip and zlib headers.
+    if (inflateInit2(&zs_, 15 + 32) != Z_OK) {
+      throw std::runtime_error("inflateInit2 failed");
+    }
+  }
+  ~GzipDecoder() override { inflateEnd(&zs_); }
+
+  bool decode(const uint8_t *&in, const uint8_t *inEnd, uint8_t *&out,
+              uint8_t *outEnd) override {
+    zs_.next_in = const_cast<Bytef *>(in);
+    zs_.avail_in = static_cast<uInt>(inEnd - in);
+    zs_.next_out = out;
+    zs_.avail_out = static_cast<uInt>(outEnd - out);
+    int ret = inflate(&zs_, Z_NO_FLUSH);
+    in = zs_.next_in;
+    out = zs_.next_out;
+    if (ret == Z_STREAM_END) {
+      // Concatenated gzip members (e.g. from pigz or cat) keep going.
+      inflateReset(&zs_);
+      return true;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      throw std::runtime_error(fmt::format("gzip decode error {}", ret));
+    }
+    return false;
+  }
+
+private:
+  z_stream zs_{};
+};
+
+#ifdef TRACE_HAVE_ZSTD
+class ZstdDecoder : public DecompressingSource::Decoder {
+public:
+  ZstdDecoder() : ds_(ZSTD_createDStream()) { ZSTD_initDStream(ds_); }
+  ~ZstdDecoder() override { ZSTD_freeDStream(ds_); }
+
+  bool decode(const uint8_t *&in, const uint8_t *inEnd, uint8_t *&out,
+              uint8_t *outEnd) override {
+    ZSTD_inBuffer input{in, static_cast<size_t>(inEnd - in), 0};
+    ZSTD_outBuffer output{out, static_cast<size_t>(outEnd - out), 0};
+    size_t ret = ZSTD_decompressStream(ds_, &output, &input);
+    if (ZSTD_isError(ret)) {
+      throw std::runtime_error(
+          fmt::format("zstd decode error: {}", ZSTD_getErrorName(ret)));
+    }
+    in += input.pos;
+    out += output.pos;
+    // ret == 0 marks the end of a frame; further frames may follow.
+    return ret == 0;
+  }
+
+private:
+  ZSTD_DStream *ds_;
+};
+#endif
+
+#ifdef TRACE_HAVE_LZ4
+class Lz4Decoder : public DecompressingSource::Decoder {
+public:
+  Lz4Decoder() {
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx_, LZ4F_VERSION))) {
+      throw std::runtime_error("LZ4F_createDecompressionContext failed");
+    }
+  }
+  ~Lz4Decoder() override { LZ4F_freeDecompressionContext(ctx_); }
+
+  bool decode(const uint8_t *&in, const uint8_t *inEnd, uint8_t *&out,
+              uint8_t *outEnd) override {
+    size_t inSize = inEnd - in;
+    size_t outSize = outEnd - out;
+    size_t ret = LZ4F_decompress(ctx_, out, &outSize, in, &inSize, nullptr);
+    if (LZ4F_isError(ret)) {
+      throw std::runtime_error(
+          fmt::format("lz4 decode error: {}", LZ4F_getErrorName(ret)));
+    }
+    in += inSize;
+    out += outSize;
+    // As for zstd, 0 marks the end of a frame.
+    return ret == 0;
+  }
+
+private:
+  LZ4F_dctx *ctx_{nullptr};
+};
+#endif
+
+std::unique_ptr<DecompressingSource::Decoder>
+makeDecoder(Compression compression, const std::filesystem::path &path) {
+  switch (compression) {
+  case Compression::kGzip:
+    return std::make_unique<GzipDecoder>();
+  case Compression::kZstd:
+#ifdef TRACE_HAVE_ZSTD
+    return std::make_unique<ZstdDecoder>();
+#else
+    throw std::runtime_error("Built without zstd support: " + path.string());
+#endif
+  case Compression::kLz4:
+#ifdef TRACE_HAVE_LZ4
+    return std::make_unique<Lz4Decoder>();
+#else
+    throw std::runtime_error("Built without lz4 support: " + path.string());
+#endif
+  case Compression::kNone:
+    break;
+  }
+  throw std::runtime_error("Not a compressed file: " + path.string());
+}
+
+} // namespace
+
+DecompressingSource::DecompressingSource(const std::filesystem::path &path,
+                                         Compression compression)
+    : path_(path), decoder_(makeDecoder(compression, path)) {
+  fd_ = ::open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+  ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  worker_ = std::thread([this] { run(); });
+}
+
+DecompressingSource::~DecompressingSource() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  worker_.join();
+  ::close(fd_);
+}
+
+bool DecompressingSource::refill() {
+  std::vector<char> chunk;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !ready_.empty() || done_; });
+    if (ready_.empty()) {
+      if (error_) {
+        std::rethrow_exception(error_);
+      }
+      return false;
+    }
+    chunk = std::move(ready_.front());
+    ready_.pop_front();
+  }
+  cv_.notify_all();
+
+  // Carry the unconsumed tail (a partial record) in front of the new
+  // chunk's data.
+  const size_t tail = end_ - cur_;
+  if (tail > kChunkHeadroom) {
+    chunk.insert(std::begin(chunk) + kChunkHeadroom, cur_, end_);
+  }
+  char *begin = chunk.data() + kChunkHeadroom;
+  if (tail > 0 && tail <= kChunkHeadroom) {
+    begin -= tail;
+    std::memcpy(begin, cur_, tail);
+  }
+  auto prev = std::exchange(buffer_, std::move(chunk));
+  if (prev.capacity() > 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    freeChunks_.push_back(std::move(prev));
+  }
+  cur_ = begin;
+  end_ = buffer_.data() + buffer_.size();
+  return true;
+}
+
+void DecompressingSource::addMemoryUsage(MemoryUsage &usage) {
+  uint64_t reserved = buffer_.capacity();
+  uint64_t used = buffer_.size();
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &chunk : ready_) {
+    reserved += chunk.capacity();
+    used += chunk.size();
+  }
+  for (const auto &chunk : freeChunks_) {
+    reserved += chunk.capacity();
+  }
+  // The chunk the worker is decoding into.
+  if (!done_) {
+    reserved += kChunkHeadroom + kChunkSize;
+    used += kChunkHeadroom + kChunkSize;
+  }
+  usage.reservedBytes += reserved;
+  usage.usedBytes += used;
+}
+
+std::vector<char> DecompressingSource::takeFreeChunk() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (freeChunks_.empty()) {
+    return {};
+  }
+  auto chunk = std::move(freeChunks_.back());
+  freeChunks_.pop_back();
+  return chunk;
+}
+
+void DecompressingSource::run() {
+  try {
+    produce();
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    error_ = std::current_exception();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  cv_.notify_all();
+}
+
+void DecompressingSource::produce() {
+  std::vector<uint8_t> input(kChunkSize);
+  const uint8_t *in = input.data();
+  const uint8_t *inEnd = input.data();
+  bool eof = false;
+  bool frameEnded = false;
+  bool streamEnded = false;
+
+  while (!streamEnded) {
+    // Free chunks keep their size, so this only allocates new ones.
+    auto chunk = takeFreeChunk();
+    chunk.resize(kChunkHeadroom + kChunkSize);
+    uint8_t *outBegin =
+        reinterpret_cast<uint8_t *>(chunk.data()) + kChunkHeadroom;
+    uint8_t *out = outBegin;
+    uint8_t *outEnd = outBegin + kChunkSize;
+
+    while (out != outEnd) {
+      if (in == inEnd && !eof) {
+        ssize_t n = ::read(fd_, input.data(), input.size());
+        if (n < 0) {
+          throw std::runtime_error("Failed to read file: " + path_.string());
+        }
+        eof = (n == 0);
+        in = input.data();
+        inEnd = in + n;
+      }
+      // The decoder may still hold output after the last input byte, so
+      // the stream only ends once a frame has.
+      if (in == inEnd && eof && frameEnded) {
+        streamEnded = true;
+        break;
+      }
+      const uint8_t *prevIn = in;
+      uint8_t *prevOut = out;
+      frameEnded = decoder_->decode(in, inEnd, out, outEnd);
+      if (in == prevIn && out == prevOut && eof && !frameEnded) {
+        throw std::runtime_error("Truncated compressed file: " +
+                                 path_.string());
+      }
+    }
+
+    if (out == outBegin) {
+      continue;
+    }
+    chunk.resize(kChunkHeadroom + (out - outBegin));
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock,
+             [this] { return ready_.size() < kMaxQueuedChunks || stop_; });
+    if (stop_) {
+      return;
+    }
+    ready_.push_back(std::move(chunk));
+    lock.unlock();
+    cv_.notify_all();
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "TraceReader.h"
+
+enum class Compression { kNone, kGzip, kZstd, kLz4 };
+
+// Sniffs the magic bytes at the start of the file.
+Compression detectCompression(const std::filesystem::path &path);
+
+// Streams a compressed trace file: a background thread reads and decodes
+// the file into fixed-size chunks, and refill() hands them to the parser.
+// Each chunk is decoded behind kChunkHeadroom spare bytes, into which
+// refill() moves the partial record left at the end of the previous one.
+class DecompressingSource : public TraceSource {
+public:
+  static constexpr size_t kChunkSize = 4 << 20;
+  // Longer partial records cost a copy of the whole chunk.
+  static constexpr size_t kChunkHeadroom = 64 << 10;
+  static constexpr size_t kMaxQueuedChunks = 4;
+
+  DecompressingSource(const std::filesystem::path &path,
+                      Compression compression);
+  ~DecompressingSource() override;
+
+  bool refill() override;
+
+  void addMemoryUsage(MemoryUsage &usage) override;
+
+  class Decoder {
+  public:
+    virtual ~Decoder() = default;
+    // Decodes from in into out, advancing both. Returns true if the input
+    // consumed so far ends a frame (gzip member) whose output is all out.
+    virtual bool decode(const uint8_t *&in, const uint8_t *inEnd, uint8_t *&out,
+                        uint8_t *outEnd) = 0;
+  };
+
+private:
+  const std::filesystem::path path_;
+  std::unique_ptr<Decoder> decoder_;
+  int fd_{-1};
+
+  std::vector<char> buffer_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::vector<char>> ready_;
+  std::vector<std::vector<char>> freeChunks_;
+  bool done_{false};
+  bool stop_{false};
+  std::exception_ptr error_;
+
+  std::thread worker_;
+
+  void run();
+  void produce();
+  std::vector<char> takeFreeChunk();
+};
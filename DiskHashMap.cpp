@@ -0,0 +1,46 @@
+#include "DiskHashMap.h"
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+ScratchMapping::ScratchMapping(const std::filesystem::path &dir, size_t size)
+    : size_(std::max(size, kPageSize)) {
+  fd_ = ::open(dir.c_str(), O_TMPFILE | O_RDWR, 0600);
+  if (fd_ < 0) {
+    throw std::runtime_error("Failed to create scratch file in: " +
+                             dir.string());
+  }
+  if (::ftruncate(fd_, size_) != 0) {
+    ::close(fd_);
+    throw std::runtime_error("Failed to size scratch file in: " +
+                             dir.string());
+  }
+  void *addr =
+      ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (addr == MAP_FAILED) {
+    ::close(fd_);
+    throw std::runtime_error("Failed to mmap scratch file in: " +
+                             dir.string());
+  }
+  data_ = static_cast<char *>(addr);
+  adviseSequential(false);
+}
+
+ScratchMapping::~ScratchMapping() {
+  ::munmap(data_, size_);
+  ::close(fd_);
+}
+
+void ScratchMapping::prefetch(size_t offset, size_t length) const {
+  offset -= offset % kPageSize;
+  if (offset >= size_) {
+    return;
+  }
+  ::madvise(data_ + offset, std::min(length, size_ - offset), MADV_WILLNEED);
+}
+
+void ScratchMapping::adviseSequential(bool sequential) const {
+  ::madvise(data_, size_, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "MemoryResource.h"
+#include "include/robin_hood.h"
+
+// Anonymous scratch file mapped shared read-write. The file is unlinked
+// from the start, so it disappears with the process. Its pages are backed
+// by the file rather than by swap, so the kernel can write them back and
+// drop them under memory pressure.
+class ScratchMapping {
+public:
+  static constexpr size_t kPageSize = 4096;
+
+  ScratchMapping(const std::filesystem::path &dir, size_t size);
+  ~ScratchMapping();
+
+  ScratchMapping(const ScratchMapping &) = delete;
+  ScratchMapping &operator=(const ScratchMapping &) = delete;
+
+  char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Starts reading [offset, offset + length) in the background.
+  void prefetch(size_t offset, size_t length) const;
+
+  // Switches between random (no readahead) and sequential access hints.
+  void adviseSequential(bool sequential) const;
+
+private:
+  int fd_{-1};
+  char *data_{nullptr};
+  size_t size_{0};
+};
+
+// Fingerprints 0 and 1 mark empty and deleted slots.
+inline constexpr uint64_t kMinFingerprint = 2;
+
+// Open-addressing hash table of fixed-size records in a ScratchMapping,
+// keyed by 64-bit fingerprints of at least kMinFingerprint. Probing is
+// linear, so a probe sequence runs through consecutive pages. When a probe
+// spills into the next page, the pages after it are prefetched. The table
+// doubles by a sequential scan of the old file.
+template <typename V> class DiskHashTable {
+  static_assert(std::is_trivially_copyable_v<V>);
+
+public:
+  explicit DiskHashTable(std::filesystem::path dir)
+      : dir_(std::move(dir)) {
+    rebuild(kInitialSlots);
+  }
+
+  // Valid until the next insert or take.
+  V *find(uint64_t key) {
+    const uint64_t i = locate(key);
+    return i == numSlots_ ? nullptr : &slots_[i].value;
+  }
+
+  // key must be absent.
+  void insert(uint64_t key, const V &value) {
+    assert(key >= kMinFingerprint);
+    if ((numLive_ + numTombstones_ + 1) * 4 > numSlots_ * 3) {
+      // Grows if at least half live; otherwise only drops the tombstones.
+      rebuild(numLive_ * 2 >= numSlots_ ? numSlots_ * 2 : numSlots_);
+    }
+    for (uint64_t i = home(key);; i = next(i)) {
+      if (slots_[i].key < kMinFingerprint) {
+        numTombstones_ -= slots_[i].key == kTombstone;
+        slots_[i].key = key;
+        std::memcpy(&slots_[i].value, &value, sizeof(V));
+        numLive_++;
+        return;
+      }
+    }
+  }
+
+  std::optional<V> take(uint64_t key) {
+    const uint64_t i = locate(key);
+    if (i == numSlots_) {
+      return std::nullopt;
+    }
+    V value;
+    std::memcpy(&value, &slots_[i].value, sizeof(V));
+    slots_[i].key = kTombstone;
+    numLive_--;
+    numTombstones_++;
+    return value;
+  }
+
+  uint64_t size() const { return numLive_; }
+
+  void addMemoryUsage(MemoryUsage &usage) const {
+    usage.reservedBytes += file_->size();
+    usage.usedBytes += numLive_ * sizeof(Slot);
+    usage.numEntries += numLive_;
+  }
+
+private:
+  struct Slot {
+    uint64_t key;
+    V value;
+  };
+
+  static constexpr uint64_t kEmpty = 0;
+  static constexpr uint64_t kTombstone = 1;
+  static constexpr uint64_t kInitialSlots = 1 << 16;
+  static constexpr uint64_t kSlotsPerPage =
+      std::max<uint64_t>(1, ScratchMapping::kPageSize / sizeof(Slot));
+  static constexpr size_t kPrefetchPages = 8;
+
+  const std::filesystem::path dir_;
+  std::unique_ptr<ScratchMapping> file_;
+  Slot *slots_{nullptr};
+  uint64_t numSlots_{0};
+  uint64_t numLive_{0};
+  uint64_t numTombstones_{0};
+
+  uint64_t home(uint64_t key) const {
+    return static_cast<uint64_t>(
+        (static_cast<unsigned __int128>(key) * numSlots_) >> 64);
+  }
+
+  uint64_t next(uint64_t i) {
+    i = i + 1 == numSlots_ ? 0 : i + 1;
+    if (i % kSlotsPerPage == 0) {
+      file_->prefetch(i * sizeof(Slot),
+                      kPrefetchPages * ScratchMapping::kPageSize);
+    }
+    return i;
+  }
+
+  // Slot index of key, or numSlots_ if absent.
+  uint64_t locate(uint64_t key) {
+    for (uint64_t i = home(key);; i = next(i)) {
+      if (slots_[i].key == key) {
+        return i;
+      }
+      if (slots_[i].key == kEmpty) {
+        return numSlots_;
+      }
+    }
+  }
+
+  void rebuild(uint64_t numSlots) {
+    auto old = std::move(file_);
+    const Slot *oldSlots = slots_;
+    const uint64_t oldNumSlots = numSlots_;
+
+    // A sparse file reads back as zeros, i.e. empty slots.
+    file_ = std::make_unique<ScratchMapping>(dir_, numSlots * sizeof(Slot));
+    slots_ = reinterpret_cast<Slot *>(file_->data());
+    numSlots_ = numSlots;
+    numLive_ = 0;
+    numTombstones_ = 0;
+
+    if (old) {
+      old->adviseSequential(true);
+      for (uint64_t i = 0; i < oldNumSlots; ++i) {
+        if (oldSlots[i].key >= kMinFingerprint) {
+          insert(oldSlots[i].key, oldSlots[i].value);
+        }
+      }
+    }
+  }
+};
+
+// 64-bit key of a DiskHashTable for a string key. Collisions are ignored;
+// among a billion keys the chance of any is about 3%.
+inline uint64_t keyFingerprint(const std::string &key) {
+  const uint64_t hash = robin_hood::hash_bytes(key.data(), key.size());
+  return hash < kMinFingerprint ? hash + kMinFingerprint : hash;
+}
+
+// Key -> V map that keeps its hot entries in DRAM and spills the rest to
+// a DiskHashTable. Keys are 64-bit fingerprints of the string keys. The
+// DRAM tier holds a fixed number of entries and picks what to demote with
+// CLOCK. A hit on the disk tier promotes the entry.
+template <typename V> class OutOfCoreMap {
+public:
+  OutOfCoreMap(const std::filesystem::path &dir, uint64_t hotBytes)
+      : hot_(std::max<uint64_t>(1, hotBytes / sizeof(HotSlot))), cold_(dir) {
+    index_.reserve(hot_.size());
+    freeSlots_.reserve(hot_.size());
+    for (uint32_t i = hot_.size(); i-- > 0;) {
+      freeSlots_.push_back(i);
+    }
+  }
+
+  // Valid until the next call.
+  V *find(uint64_t key) {
+    if (auto it = index_.find(key); it != std::end(index_)) {
+      hot_[it->second].referenced = true;
+      return &hot_[it->second].value;
+    }
+    if (auto value = cold_.take(key)) {
+      return &promote(key, *value);
+    }
+    return nullptr;
+  }
+
+  // Like find(), but neither promotes a cold entry nor marks a hot one
+  // referenced, so one-off reads do not push hot entries out.
+  std::optional<V> peek(uint64_t key) {
+    if (auto it = index_.find(key); it != std::end(index_)) {
+      return hot_[it->second].value;
+    }
+    if (const V *value = cold_.find(key)) {
+      return *value;
+    }
+    return std::nullopt;
+  }
+
+  // Inserts a value-initialized entry if key is absent.
+  V &operator[](uint64_t key) {
+    if (V *value = find(key)) {
+      return *value;
+    }
+    return promote(key, V{});
+  }
+
+  // Removes key and returns its value, without promoting it.
+  std::optional<V> take(uint64_t key) {
+    if (auto it = index_.find(key); it != std::end(index_)) {
+      const uint32_t slot = it->second;
+      index_.erase(key);
+      freeSlots_.push_back(slot);
+      return hot_[slot].value;
+    }
+    return cold_.take(key);
+  }
+
+  uint64_t size() const { return index_.size() + cold_.size(); }
+
+  void addMemoryUsage(MemoryUsage &hot, MemoryUsage &cold) const {
+    hot.reservedBytes += hot_.capacity() * sizeof(HotSlot);
+    hot.usedBytes += index_.size() * sizeof(HotSlot);
+    addTableUsage(hot, index_);
+    cold_.addMemoryUsage(cold);
+  }
+
+private:
+  struct HotSlot {
+    uint64_t key{0};
+    V value{};
+    bool referenced{false};
+  };
+
+  std::vector<HotSlot> hot_;
+  robin_hood::unordered_flat_map<uint64_t, uint32_t> index_;
+  std::vector<uint32_t> freeSlots_;
+  uint32_t hand_{0};
+  DiskHashTable<V> cold_;
+
+  V &promote(uint64_t key, const V &value) {
+    if (freeSlots_.empty()) {
+      demote();
+    }
+    const uint32_t slot = freeSlots_.back();
+    freeSlots_.pop_back();
+    hot_[slot] = {.key = key, .value = value, .referenced = false};
+    index_[key] = slot;
+    return hot_[slot].value;
+  }
+
+  // Moves the first unreferenced entry under the clock hand to disk.
+  void demote() {
+    while (true) {
+      auto &slot = hot_[hand_];
+      hand_ = hand_ + 1 == hot_.size() ? 0 : hand_ + 1;
+      if (slot.referenced) {
+        slot.referenced = false;
+        continue;
+      }
+      cold_.insert(slot.key, slot.value);
+      freeSlots_.push_back(&slot - hot_.data());
+      index_.erase(slot.key);
+      return;
+    }
+  }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Min-heap of timestamped events for the discrete-event simulator.
+// A 4-ary layout keeps the heap shallow and sift-down cache friendly, and
+// events are small PODs so billions of push/pop pairs never allocate once
+// the backing vector has grown to the peak number of in-flight events.
+class EventQueue {
+public:
+  struct Event {
+    uint64_t time;
+    uint32_t type;
+    uint32_t arg;
+  };
+
+  bool empty() const { return heap_.empty(); }
+  size_t size() const { return heap_.size(); }
+  size_t capacity() const { return heap_.capacity(); }
+
+  const Event &top() const {
+    assert(!heap_.empty());
+    return heap_.front();
+  }
+
+  void push(const Event &e) {
+    heap_.push_back(e);
+    siftUp(heap_.size() - 1);
+  }
+
+  Event pop() {
+    assert(!heap_.empty());
+    Event e = heap_.front();
+    heap_.front() = heap_.back();
+    heap_.pop_back();
+    if (!heap_.empty()) {
+      siftDown(0);
+    }
+    return e;
+  }
+
+  void reserve(size_t n) { heap_.reserve(n); }
+
+private:
+  static constexpr size_t kArity = 4;
+
+  std::vector<Event> heap_;
+
+  void siftUp(size_t idx) {
+    Event e = heap_[idx];
+    while (idx > 0) {
+      size_t parent = (idx - 1) / kArity;
+      if (heap_[parent].time <= e.time) {
+        break;
+      }
+      heap_[idx] = heap_[parent];
+      idx = parent;
+    }
+    heap_[idx] = e;
+  }
+
+  void siftDown(size_t idx) {
+    const size_t n = heap_.size();
+    Event e = heap_[idx];
+    while (true) {
+      size_t first = idx * kArity + 1;
+      if (first >= n) {
+        break;
+      }
+      size_t last = std::min(first + kArity, n);
+      size_t minChild = first;
+      for (size_t c = first + 1; c < last; ++c) {
+        if (heap_[c].time < heap_[minChild].time) {
+          minChild = c;
+        }
+      }
+      if (e.time <= heap_[minChild].time) {
+        break;
+      }
+      heap_[idx] = heap_[minChild];
+      idx = minChild;
+    }
+    heap_[idx] = e;
+  }
+};
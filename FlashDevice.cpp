@@ -0,0 +1,495 @@
+#include "FlashDevice.h"
+
+#include <algorithm>
+#include <cassert>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "SpecParser.h"
+#include "include/fmt/core.h"
+
+namespace {
+
+constexpr std::string_view kSpecName = "flash device";
+
+constexpr uint32_t kNone = UINT32_MAX;
+constexpr double MB = 1024 * 1024;
+
+// Zoned namespace: zones are written sequentially and only freed by a
+// reset. Each write stream appends its sealed segments to a zone of its
+// own, so a segment lands wherever its stream's zone is, and a zone is
+// reset once every segment in it has been trimmed. Opening a zone past the
+// active limit finishes the least recently written active zone, whose
+// unwritten remainder is padded; past the open limit, the least recently
+// written open zone is closed. When no zone is empty, the full zone with
+// the fewest live segments is garbage collected by the host: its live
+// segments are rewritten into it after the reset.
+class ZnsDevice : public FlashDevice {
+public:
+  ZnsDevice(const FlashDeviceConfig &config, uint32_t numSegments,
+            uint32_t segmentSize)
+      : segmentSize_(segmentSize),
+        segmentsPerZone_(config.zoneMb == 0
+                             ? 1
+                             : (uint64_t{config.zoneMb} << 20) / segmentSize),
+        maxOpen_(config.maxOpenZones), maxActive_(config.maxActiveZones),
+        locations_(numSegments, {kNone, 0}) {
+    if (config.zoneMb != 0 &&
+        (uint64_t{config.zoneMb} << 20) % segmentSize != 0) {
+      throw std::runtime_error(
+          fmt::format("ZNS zone capacity of {} MB is not a multiple of the "
+                      "{} KB segment size",
+                      config.zoneMb, segmentSize / 1024));
+    }
+    const uint32_t numZones =
+        (numSegments + segmentsPerZone_ - 1) / segmentsPerZone_ +
+        config.spareZones;
+    zones_.resize(numZones);
+    for (uint32_t i = numZones; i-- > 0;) {
+      emptyZones_.push_back(i);
+    }
+  }
+
+  void writeSegment(uint32_t segId, uint32_t streamId) override {
+    trimSegment(segId);
+    if (streamId >= streamZones_.size()) {
+      streamZones_.resize(streamId + 1, kNone);
+    }
+    if (streamZones_[streamId] == kNone) {
+      streamZones_[streamId] = openZone();
+    } else if (zones_[streamZones_[streamId]].state == ZoneState::kClosed) {
+      reopen(streamZones_[streamId]);
+    }
+    const uint32_t zoneId = streamZones_[streamId];
+    append(zoneId, segId);
+    zones_[zoneId].lastWrite = ++numHostSegments_;
+    if (zones_[zoneId].slots.size() == segmentsPerZone_) {
+      markFull(zoneId);
+      streamZones_[streamId] = kNone;
+    }
+  }
+
+  void trimSegment(uint32_t segId) override {
+    const auto [zoneId, slot] = locations_[segId];
+    if (zoneId == kNone) {
+      return;
+    }
+    auto &zone = zones_[zoneId];
+    zone.slots[slot] = kNone;
+    zone.numLive--;
+    locations_[segId] = {kNone, 0};
+    if (zone.state == ZoneState::kFull && zone.numLive == 0) {
+      reset(zoneId);
+      emptyZones_.push_back(zoneId);
+    }
+  }
+
+  void report(std::ostream &os) const override {
+    const double hostMb = numHostSegments_ * segmentSize_ / MB;
+    const uint64_t nandSegments =
+        numHostSegments_ + numRelocatedSegments_ + numPaddedSegments_;
+    os << fmt::format("ZNS: {} zones of {} segments ({:.1f} MB), at most {} "
+                      "open / {} active",
+                      zones_.size(), segmentsPerZone_,
+                      segmentsPerZone_ * segmentSize_ / MB, maxOpen_,
+                      maxActive_)
+       << std::endl;
+    os << fmt::format(
+              "ZNS: {:.1f} MB host writes, {:.1f} MB relocated by host GC, "
+              "{:.1f} MB finish padding, device WA {:.3f}; {} resets, {} "
+              "finishes, {} closes",
+              hostMb, numRelocatedSegments_ * segmentSize_ / MB,
+              numPaddedSegments_ * segmentSize_ / MB,
+              numHostSegments_ > 0
+                  ? static_cast<double>(nandSegments) / numHostSegments_
+                  : 0.0,
+              numResets_, numFinishes_, numCloses_)
+       << std::endl;
+  }
+
+private:
+  enum class ZoneState : uint8_t { kEmpty, kOpen, kClosed, kFull };
+
+  struct Zone {
+    ZoneState state{ZoneState::kEmpty};
+    // Segment written to each slot so far; kNone once trimmed.
+    std::vector<uint32_t> slots;
+    uint32_t numLive{0};
+    uint64_t lastWrite{0};
+  };
+
+  struct Location {
+    uint32_t zone;
+    uint32_t slot;
+  };
+
+  const uint32_t segmentSize_;
+  const uint32_t segmentsPerZone_;
+  const uint32_t maxOpen_;
+  const uint32_t maxActive_;
+
+  std::vector<Zone> zones_;
+  std::vector<uint32_t> emptyZones_;
+  // By segment id.
+  std::vector<Location> locations_;
+  // Zone each stream appends to, kNone until its next write.
+  std::vector<uint32_t> streamZones_;
+  uint32_t numOpen_{0};
+  uint32_t numActive_{0};
+
+  uint64_t numHostSegments_{0};
+  uint64_t numRelocatedSegments_{0};
+  uint64_t numPaddedSegments_{0};
+  uint64_t numResets_{0};
+  uint64_t numFinishes_{0};
+  uint64_t numCloses_{0};
+
+  void append(uint32_t zoneId, uint32_t segId) {
+    auto &zone = zones_[zoneId];
+    assert(zone.slots.size() < segmentsPerZone_);
+    locations_[segId] = {zoneId, static_cast<uint32_t>(zone.slots.size())};
+    zone.slots.push_back(segId);
+    zone.numLive++;
+  }
+
+  // Least recently written zone a stream holds in state; kNone if none.
+  uint32_t lruStreamZone(ZoneState state, uint32_t except = kNone) const {
+    uint32_t lru = kNone;
+    for (const uint32_t zoneId : streamZones_) {
+      if (zoneId != kNone && zoneId != except &&
+          zones_[zoneId].state == state &&
+          (lru == kNone || zones_[zoneId].lastWrite < zones_[lru].lastWrite)) {
+        lru = zoneId;
+      }
+    }
+    return lru;
+  }
+
+  uint32_t openZone() {
+    if (numActive_ == maxActive_) {
+      uint32_t victim = lruStreamZone(ZoneState::kClosed);
+      if (victim == kNone) {
+        victim = lruStreamZone(ZoneState::kOpen);
+      }
+      finish(victim);
+    }
+    if (numOpen_ == maxOpen_) {
+      close(lruStreamZone(ZoneState::kOpen));
+    }
+    const uint32_t zoneId = takeEmptyZone();
+    zones_[zoneId].state = ZoneState::kOpen;
+    numOpen_++;
+    numActive_++;
+    return zoneId;
+  }
+
+  void reopen(uint32_t zoneId) {
+    if (numOpen_ == maxOpen_) {
+      close(lruStreamZone(ZoneState::kOpen, zoneId));
+    }
+    zones_[zoneId].state = ZoneState::kOpen;
+    numOpen_++;
+  }
+
+  void close(uint32_t zoneId) {
+    assert(zones_[zoneId].state == ZoneState::kOpen);
+    zones_[zoneId].state = ZoneState::kClosed;
+    numOpen_--;
+    numCloses_++;
+  }
+
+  // Moves an active zone to full; its stream opens a new one next time.
+  // The unwritten remainder is padded, which costs NAND programs.
+  void finish(uint32_t zoneId) {
+    numPaddedSegments_ += segmentsPerZone_ - zones_[zoneId].slots.size();
+    numFinishes_++;
+    std::replace(std::begin(streamZones_), std::end(streamZones_), zoneId,
+                 kNone);
+    markFull(zoneId);
+  }
+
+  void markFull(uint32_t zoneId) {
+    auto &zone = zones_[zoneId];
+    numOpen_ -= zone.state == ZoneState::kOpen;
+    numActive_--;
+    zone.state = ZoneState::kFull;
+    if (zone.numLive == 0) {
+      reset(zoneId);
+      emptyZones_.push_back(zoneId);
+    }
+  }
+
+  void reset(uint32_t zoneId) {
+    auto &zone = zones_[zoneId];
+    zone.state = ZoneState::kEmpty;
+    zone.slots.clear();
+    zone.numLive = 0;
+    numResets_++;
+  }
+
+  uint32_t takeEmptyZone() {
+    if (!emptyZones_.empty()) {
+      const uint32_t zoneId = emptyZones_.back();
+      emptyZones_.pop_back();
+      return zoneId;
+    }
+    uint32_t victim = kNone;
+    for (uint32_t i = 0; i < zones_.size(); ++i) {
+      if (zones_[i].state == ZoneState::kFull &&
+          (victim == kNone || zones_[i].numLive < zones_[victim].numLive)) {
+        victim = i;
+      }
+    }
+    if (victim == kNone || zones_[victim].numLive == segmentsPerZone_) {
+      throw std::runtime_error(
+          "ZNS device ran out of zones; add spare zones or active zones");
+    }
+    std::vector<uint32_t> live;
+    for (const uint32_t segId : zones_[victim].slots) {
+      if (segId != kNone) {
+        live.push_back(segId);
+      }
+    }
+    reset(victim);
+    for (const uint32_t segId : live) {
+      append(victim, segId);
+    }
+    numRelocatedSegments_ += live.size();
+    return victim;
+  }
+};
+
+// Conventional SSD: logical pages are mapped to physical pages one by one
+// and written at a single write frontier, whatever stream they come from.
+// Overwritten and trimmed pages become invalid in place. When only the GC
+// reserve of free blocks is left, greedy GC erases the full block with the
+// fewest valid pages after copying those to the frontier. Segment i is
+// logical pages [i * pagesPerSegment, (i + 1) * pagesPerSegment).
+class FtlDevice : public FlashDevice {
+public:
+  FtlDevice(const FlashDeviceConfig &config, uint32_t numSegments,
+            uint32_t segmentSize)
+      : pageSize_(config.pageKb * 1024), blockKb_(config.blockKb),
+        overProvisioningPct_(config.overProvisioningPct), trim_(config.trim),
+        pagesPerSegment_(segmentSize / pageSize_),
+        pagesPerBlock_(uint64_t{config.blockKb} * 1024 / pageSize_) {
+    if (pageSize_ == 0 || segmentSize % pageSize_ != 0 ||
+        (uint64_t{config.blockKb} * 1024) % pageSize_ != 0 ||
+        pagesPerBlock_ == 0) {
+      throw std::runtime_error(fmt::format(
+          "FTL pages of {} KB must divide both the {} KB segments and the {} "
+          "KB erase blocks",
+          config.pageKb, segmentSize / 1024, config.blockKb));
+    }
+    const uint64_t numLogicalPages =
+        uint64_t{numSegments} * pagesPerSegment_;
+    const uint64_t numPhysicalPages =
+        numLogicalPages * (100 + overProvisioningPct_) / 100;
+    const uint64_t numBlocks =
+        std::max((numPhysicalPages + pagesPerBlock_ - 1) / pagesPerBlock_,
+                 (numLogicalPages + pagesPerBlock_ - 1) / pagesPerBlock_ +
+                     kGcReserve + 1);
+    if (numBlocks * pagesPerBlock_ >= kNone) {
+      throw std::runtime_error("FTL model is limited to 2^32 pages");
+    }
+    logicalToPhysical_.assign(numLogicalPages, kNone);
+    physicalToLogical_.assign(numBlocks * pagesPerBlock_, kNone);
+    blocks_.resize(numBlocks);
+    for (uint32_t i = numBlocks; i-- > 0;) {
+      freeBlocks_.push_back(i);
+    }
+  }
+
+  void writeSegment(uint32_t segId, uint32_t /* streamId */) override {
+    const uint64_t first = uint64_t{segId} * pagesPerSegment_;
+    for (uint64_t lpn = first; lpn < first + pagesPerSegment_; ++lpn) {
+      invalidate(lpn);
+      program(lpn, false);
+    }
+    numHostPages_ += pagesPerSegment_;
+  }
+
+  void trimSegment(uint32_t segId) override {
+    if (!trim_) {
+      return;
+    }
+    const uint64_t first = uint64_t{segId} * pagesPerSegment_;
+    for (uint64_t lpn = first; lpn < first + pagesPerSegment_; ++lpn) {
+      invalidate(lpn);
+    }
+  }
+
+  void report(std::ostream &os) const override {
+    const double pageMb = pageSize_ / MB;
+    os << fmt::format("FTL: {} erase blocks of {} KB, {} KB pages, {}% "
+                      "over-provisioning, {}",
+                      blocks_.size(), blockKb_, pageSize_ / 1024,
+                      overProvisioningPct_, trim_ ? "trim" : "no trim")
+       << std::endl;
+    os << fmt::format("FTL: {:.1f} MB host writes, {:.1f} MB GC writes, {} "
+                      "erases, device WA {:.3f} (NAND writes per host write)",
+                      numHostPages_ * pageMb, numGcPages_ * pageMb,
+                      numErases_,
+                      numHostPages_ > 0
+                          ? static_cast<double>(numHostPages_ + numGcPages_) /
+                                numHostPages_
+                          : 0.0)
+       << std::endl;
+  }
+
+private:
+  // Free blocks only GC may take, so that it can always make progress.
+  static constexpr uint32_t kGcReserve = 1;
+
+  struct Block {
+    uint32_t numValid{0};
+    uint32_t writePtr{0};
+  };
+
+  const uint32_t pageSize_;
+  const uint32_t blockKb_;
+  const uint32_t overProvisioningPct_;
+  const bool trim_;
+  const uint32_t pagesPerSegment_;
+  const uint32_t pagesPerBlock_;
+
+  std::vector<uint32_t> logicalToPhysical_;
+  std::vector<uint32_t> physicalToLogical_;
+  std::vector<Block> blocks_;
+  std::vector<uint32_t> freeBlocks_;
+  // Full blocks by valid page count, for greedy victim selection.
+  std::set<std::pair<uint32_t, uint32_t>> fullBlocks_;
+  uint32_t frontier_{kNone};
+
+  uint64_t numHostPages_{0};
+  uint64_t numGcPages_{0};
+  uint64_t numErases_{0};
+
+  uint32_t takeFreeBlock() {
+    assert(!freeBlocks_.empty());
+    const uint32_t blockId = freeBlocks_.back();
+    freeBlocks_.pop_back();
+    return blockId;
+  }
+
+  void invalidate(uint64_t lpn) {
+    const uint32_t ppn = std::exchange(logicalToPhysical_[lpn], kNone);
+    if (ppn == kNone) {
+      return;
+    }
+    physicalToLogical_[ppn] = kNone;
+    const uint32_t blockId = ppn / pagesPerBlock_;
+    auto &block = blocks_[blockId];
+    if (blockId != frontier_) {
+      fullBlocks_.erase({block.numValid, blockId});
+      fullBlocks_.insert({block.numValid - 1, blockId});
+    }
+    block.numValid--;
+  }
+
+  // Host writes may only take a free block beyond the GC reserve. GC run
+  // on their behalf copies into the frontier too, so it is checked again
+  // after every collection: GC may leave it with room, or fill it.
+  void program(uint64_t lpn, bool isGc) {
+    while (frontier_ == kNone ||
+           blocks_[frontier_].writePtr == pagesPerBlock_) {
+      if (frontier_ != kNone) {
+        fullBlocks_.insert({blocks_[frontier_].numValid, frontier_});
+        frontier_ = kNone;
+      } else if (!isGc && freeBlocks_.size() <= kGcReserve) {
+        collect();
+      } else {
+        frontier_ = takeFreeBlock();
+      }
+    }
+    auto &block = blocks_[frontier_];
+    const uint32_t ppn = frontier_ * pagesPerBlock_ + block.writePtr++;
+    physicalToLogical_[ppn] = lpn;
+    logicalToPhysical_[lpn] = ppn;
+    block.numValid++;
+  }
+
+  // Copies the valid pages of the full block with the fewest of them to
+  // the frontier and erases it.
+  void collect() {
+    assert(!fullBlocks_.empty());
+    const auto [numValid, victim] = *std::begin(fullBlocks_);
+    if (numValid == pagesPerBlock_) {
+      throw std::runtime_error(
+          "FTL model ran out of space; raise the over-provisioning");
+    }
+    fullBlocks_.erase(std::begin(fullBlocks_));
+    for (uint32_t i = 0; i < pagesPerBlock_; ++i) {
+      const uint32_t ppn = victim * pagesPerBlock_ + i;
+      const uint64_t lpn = physicalToLogical_[ppn];
+      if (lpn == kNone) {
+        continue;
+      }
+      physicalToLogical_[ppn] = kNone;
+      program(lpn, true);
+      numGcPages_++;
+    }
+    blocks_[victim] = {};
+    freeBlocks_.push_back(victim);
+    numErases_++;
+  }
+};
+
+} // namespace
+
+FlashDeviceConfig parseFlashDeviceConfig(std::string_view spec) {
+  FlashDeviceConfig config;
+  const auto kind = nextToken(spec, ',');
+  if (kind == "zns") {
+    config.kind = FlashDeviceConfig::Kind::kZns;
+  } else if (kind == "ftl") {
+    config.kind = FlashDeviceConfig::Kind::kFtl;
+  } else {
+    throw std::invalid_argument(
+        fmt::format("Unknown flash device kind: {}", kind));
+  }
+  while (!spec.empty()) {
+    auto value = nextToken(spec, ',');
+    const auto key = nextToken(value, '=');
+    if (key == "zone-mb") {
+      config.zoneMb = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "max-open") {
+      config.maxOpenZones = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "max-active") {
+      config.maxActiveZones = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "spare-zones") {
+      config.spareZones = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "page-kb") {
+      config.pageKb = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "block-kb") {
+      config.blockKb = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "op") {
+      config.overProvisioningPct =
+          parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "trim") {
+      config.trim = true;
+    } else {
+      throw std::invalid_argument(
+          fmt::format("Unknown flash device parameter: {}", key));
+    }
+  }
+
+  if (config.maxOpenZones == 0 || config.maxActiveZones < config.maxOpenZones) {
+    throw std::invalid_argument("Inconsistent flash device parameters");
+  }
+  return config;
+}
+
+std::unique_ptr<FlashDevice> makeFlashDevice(const FlashDeviceConfig &config,
+                                             uint32_t numSegments,
+                                             uint32_t segmentSize) {
+  switch (config.kind) {
+  case FlashDeviceConfig::Kind::kZns:
+    return std::make_unique<ZnsDevice>(config, numSegments, segmentSize);
+  case FlashDeviceConfig::Kind::kFtl:
+    return std::make_unique<FtlDevice>(config, numSegments, segmentSize);
+  }
+  return nullptr;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string_view>
+
+// Device under the FIFO, given on the command line as its kind followed by
+// comma-separated parameters, e.g.
+//   zns,zone-mb=4,max-open=8,max-active=12
+//   ftl,block-kb=4096,op=7,trim
+struct FlashDeviceConfig {
+  enum class Kind { kZns, kFtl };
+
+  Kind kind{Kind::kZns};
+
+  // Zoned namespace. Zone capacity must be a multiple of the segment size;
+  // 0: one segment per zone.
+  uint32_t zoneMb{0};
+  uint32_t maxOpenZones{14};
+  uint32_t maxActiveZones{14};
+  // Zones beyond those needed to hold the FIFO.
+  uint32_t spareZones{2};
+
+  // Conventional page-mapped FTL. The segment size must be a multiple of
+  // the page size.
+  uint32_t pageKb{4};
+  uint32_t blockKb{4096};
+  // Physical capacity beyond the FIFO, in percent.
+  uint32_t overProvisioningPct{7};
+  // Reclaimed segments are discarded rather than only overwritten.
+  bool trim{false};
+};
+
+// Throws std::invalid_argument on unknown keys or malformed values.
+FlashDeviceConfig parseFlashDeviceConfig(std::string_view spec);
+
+// Model of the NAND device the FIFO writes to, fed whole segments: a sealed
+// segment is written, and a segment the write head reclaims is trimmed. It
+// counts what the device writes to NAND for the host writes it gets.
+class FlashDevice {
+public:
+  virtual ~FlashDevice() = default;
+
+  // streamId: write stream that sealed the segment.
+  virtual void writeSegment(uint32_t segId, uint32_t streamId) = 0;
+
+  // Drops the data of segId; no-op if it was never written.
+  virtual void trimSegment(uint32_t segId) = 0;
+
+  virtual void report(std::ostream &os) const = 0;
+};
+
+// Throws std::runtime_error if the geometry does not fit the FIFO.
+std::unique_ptr<FlashDevice> makeFlashDevice(const FlashDeviceConfig &config,
+                                             uint32_t numSegments,
+                                             uint32_t segmentSize);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// Non-owning reference to a callable, two pointers wide. Unlike
+// std::function it never allocates, and unlike a template parameter it
+// can cross virtual calls. The referenced callable must outlive the
+// FunctionRef, which holds for the usual case of a lambda passed as an
+// argument.
+template <typename Fn> class FunctionRef;
+
+template <typename R, typename... Args> class FunctionRef<R(Args...)> {
+public:
+  template <typename F>
+    requires(!std::is_same_v<std::remove_cvref_t<F>, FunctionRef> &&
+             std::is_invocable_r_v<R, F &, Args...>)
+  FunctionRef(F &&f)
+      : obj_(const_cast<void *>(
+            static_cast<const void *>(std::addressof(f)))),
+        call_([](void *obj, Args... args) -> R {
+          return (*static_cast<std::remove_reference_t<F> *>(obj))(
+              std::forward<Args>(args)...);
+        }) {}
+
+  R operator()(Args... args) const {
+    return call_(obj_, std::forward<Args>(args)...);
+  }
+
+private:
+  void *obj_;
+  R (*call_)(void *, Args...);
+};
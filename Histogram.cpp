@@ -0,0 +1,12 @@
+#include "Histogram.h"
+
+#include "include/fmt/core.h"
+
+void printHistogram(std::ostream &os, const char *name, const Histogram &h) {
+  os << fmt::format("  {:<18} n={} mean={:.1f}us p50={:.1f}us p90={:.1f}us "
+                    "p99={:.1f}us p99.9={:.1f}us max={:.1f}us",
+                    name, h.count(), h.mean() / 1e3, h.percentile(50) / 1e3,
+                    h.percentile(90) / 1e3, h.percentile(99) / 1e3,
+                    h.percentile(99.9) / 1e3, h.max() / 1e3)
+     << std::endl;
+}
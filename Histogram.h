@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+
+// Log-linear histogram: every power of two is split into kSubBuckets linear
+// buckets, so the relative error of a reported percentile is bounded by
+// 1 / kSubBuckets regardless of magnitude. Fixed size, no allocation.
+class Histogram {
+public:
+  static constexpr uint32_t kSubBucketBits = 4;
+  static constexpr uint32_t kSubBuckets = 1u << kSubBucketBits;
+  static constexpr uint32_t kNumBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  void record(uint64_t value, uint64_t count = 1) {
+    counts_[bucketOf(value)] += count;
+    numSamples_ += count;
+    sum_ += value * count;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+
+  void merge(const Histogram &other) {
+    for (uint32_t i = 0; i < kNumBuckets; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    numSamples_ += other.numSamples_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+
+  void reset() { *this = Histogram(); }
+
+  uint64_t count() const { return numSamples_; }
+  uint64_t min() const { return numSamples_ ? min_ : 0; }
+  uint64_t max() const { return max_; }
+
+  double mean() const {
+    return numSamples_ ? static_cast<double>(sum_) / numSamples_ : 0.0;
+  }
+
+  // p in [0, 100]. Returns the upper bound of the bucket holding the
+  // requested rank, clamped to the observed maximum.
+  uint64_t percentile(double p) const {
+    if (numSamples_ == 0) {
+      return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * numSamples_);
+    rank = std::clamp<uint64_t>(rank, 1, numSamples_);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < kNumBuckets; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(bucketUpperBound(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  // Iterates over non-empty buckets as (lowerBound, upperBound, count).
+  template <typename Fn> void forEachBucket(Fn &&fn) const {
+    for (uint32_t i = 0; i < kNumBuckets; ++i) {
+      if (counts_[i] > 0) {
+        fn(bucketLowerBound(i), bucketUpperBound(i), counts_[i]);
+      }
+    }
+  }
+
+private:
+  std::array<uint64_t, kNumBuckets> counts_{};
+  uint64_t numSamples_{0};
+  uint64_t sum_{0};
+  uint64_t min_{std::numeric_limits<uint64_t>::max()};
+  uint64_t max_{0};
+
+  static uint32_t bucketOf(uint64_t value) {
+    if (value < kSubBuckets) {
+      return static_cast<uint32_t>(value);
+    }
+    uint32_t exp = 63 - std::countl_zero(value);
+    uint32_t shift = exp - kSubBucketBits;
+    uint32_t sub = static_cast<uint32_t>(value >> shift) & (kSubBuckets - 1);
+    return (shift + 1) * kSubBuckets + sub;
+  }
+
+  static uint64_t bucketLowerBound(uint32_t idx) {
+    if (idx < kSubBuckets) {
+      return idx;
+    }
+    uint32_t shift = idx / kSubBuckets - 1;
+    uint64_t sub = idx % kSubBuckets;
+    return (kSubBuckets + sub) << shift;
+  }
+
+  static uint64_t bucketUpperBound(uint32_t idx) {
+    if (idx < kSubBuckets) {
+      return idx;
+    }
+    uint32_t shift = idx / kSubBuckets - 1;
+    return bucketLowerBound(idx) + (uint64_t{1} << shift) - 1;
+  }
+};
+
+// One line with the count, mean and tail percentiles of a histogram of
+// nanoseconds, in microseconds.
+void printHistogram(std::ostream &os, const char *name, const Histogram &h);
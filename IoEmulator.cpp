@@ -0,0 +1,493 @@
+#include "IoEmulator.h"
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#include "fifo.h"
+#include "include/fmt/core.h"
+
+namespace {
+
+constexpr size_t kAlignment = 4096;
+
+// Item header on flash: key hash, size, expiry time, padding.
+constexpr uint32_t kHeaderSize = Fifo::Item::kMetadataSize;
+static_assert(kHeaderSize >= sizeof(uint64_t) + 2 * sizeof(uint32_t));
+
+// 0 marks the end of the records in a page.
+uint64_t recordKeyOf(const std::string &key) {
+  const uint64_t hash = robin_hood::hash_bytes(key.data(), key.size());
+  return hash == 0 ? 1 : hash;
+}
+
+std::string errnoMessage(int error) { return std::strerror(error); }
+
+// Raw io_uring (no liburing): one submission per request and completions
+// polled from the shared ring.
+class UringBackend : public IoBackend {
+public:
+  static std::unique_ptr<IoBackend> create(int fd, uint32_t depth) {
+    io_uring_params params{};
+    const int ringFd = syscall(__NR_io_uring_setup, depth, &params);
+    if (ringFd < 0) {
+      return nullptr;
+    }
+    return std::unique_ptr<IoBackend>(new UringBackend(fd, ringFd, params));
+  }
+
+  ~UringBackend() override {
+    ::munmap(sqes_, sqesSize_);
+    if (cqRing_ != sqRing_) {
+      ::munmap(cqRing_, cqRingSize_);
+    }
+    ::munmap(sqRing_, sqRingSize_);
+    ::close(ringFd_);
+  }
+
+  void submit(bool isWrite, void *buf, uint32_t length, uint64_t offset,
+              uint64_t tag) override {
+    const unsigned tail = *sqTail_;
+    assert(tail - std::atomic_ref<unsigned>(*sqHead_).load(
+                      std::memory_order_acquire) <
+           sqEntries_);
+    const unsigned idx = tail & sqMask_;
+    io_uring_sqe &sqe = sqes_[idx];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe.fd = fd_;
+    sqe.addr = reinterpret_cast<uint64_t>(buf);
+    sqe.len = length;
+    sqe.off = offset;
+    sqe.user_data = tag;
+    sqArray_[idx] = idx;
+    std::atomic_ref<unsigned>(*sqTail_).store(tail + 1,
+                                              std::memory_order_release);
+    if (syscall(__NR_io_uring_enter, ringFd_, 1, 0, 0, nullptr, 0) < 0) {
+      throw std::runtime_error("io_uring_enter failed: " +
+                               errnoMessage(errno));
+    }
+  }
+
+  void reap(bool wait, Completion onDone) override {
+    while (true) {
+      unsigned head = *cqHead_;
+      const unsigned tail =
+          std::atomic_ref<unsigned>(*cqTail_).load(std::memory_order_acquire);
+      if (head != tail) {
+        for (; head != tail; ++head) {
+          const io_uring_cqe &cqe = cqes_[head & cqMask_];
+          onDone(cqe.user_data, cqe.res);
+        }
+        std::atomic_ref<unsigned>(*cqHead_).store(head,
+                                                  std::memory_order_release);
+        return;
+      }
+      if (!wait) {
+        return;
+      }
+      if (syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS,
+                  nullptr, 0) < 0 &&
+          errno != EINTR) {
+        throw std::runtime_error("io_uring_enter failed: " +
+                                 errnoMessage(errno));
+      }
+    }
+  }
+
+  const char *name() const override { return "io_uring"; }
+
+private:
+  const int fd_;
+  const int ringFd_;
+  unsigned sqEntries_;
+  size_t sqRingSize_;
+  size_t cqRingSize_;
+  size_t sqesSize_;
+  void *sqRing_;
+  void *cqRing_;
+  io_uring_sqe *sqes_;
+  unsigned *sqHead_;
+  unsigned *sqTail_;
+  unsigned sqMask_;
+  unsigned *sqArray_;
+  unsigned *cqHead_;
+  unsigned *cqTail_;
+  unsigned cqMask_;
+  io_uring_cqe *cqes_;
+
+  UringBackend(int fd, int ringFd, const io_uring_params &params)
+      : fd_(fd), ringFd_(ringFd), sqEntries_(params.sq_entries) {
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+      sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mapRing(sqRingSize_, IORING_OFF_SQ_RING);
+    cqRing_ = singleMmap ? sqRing_ : mapRing(cqRingSize_, IORING_OFF_CQ_RING);
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(mapRing(sqesSize_, IORING_OFF_SQES));
+
+    auto *sq = static_cast<char *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto *cq = static_cast<char *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  }
+
+  void *mapRing(size_t size, uint64_t offset) {
+    void *addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringFd_, offset);
+    if (addr == MAP_FAILED) {
+      throw std::runtime_error("Failed to map io_uring ring: " +
+                               errnoMessage(errno));
+    }
+    return addr;
+  }
+};
+
+// pread/pwrite on a pool of worker threads.
+class ThreadPoolBackend : public IoBackend {
+public:
+  ThreadPoolBackend(int fd, uint32_t numThreads) : fd_(fd) {
+    for (uint32_t i = 0; i < numThreads; ++i) {
+      workers_.emplace_back([this] { run(); });
+    }
+  }
+
+  ~ThreadPoolBackend() override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    requestCv_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  void submit(bool isWrite, void *buf, uint32_t length, uint64_t offset,
+              uint64_t tag) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      requests_.push_back({isWrite, buf, length, offset, tag});
+    }
+    requestCv_.notify_one();
+  }
+
+  void reap(bool wait, Completion onDone) override {
+    std::deque<std::pair<uint64_t, int64_t>> done;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (wait) {
+        doneCv_.wait(lock, [this] { return !done_.empty(); });
+      }
+      done.swap(done_);
+    }
+    for (const auto &[tag, result] : done) {
+      onDone(tag, result);
+    }
+  }
+
+  const char *name() const override { return "thread pool"; }
+
+private:
+  struct Request {
+    bool isWrite;
+    void *buf;
+    uint32_t length;
+    uint64_t offset;
+    uint64_t tag;
+  };
+
+  const int fd_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable requestCv_;
+  std::condition_variable doneCv_;
+  std::deque<Request> requests_;
+  std::deque<std::pair<uint64_t, int64_t>> done_;
+  bool stop_{false};
+
+  void run() {
+    while (true) {
+      Request request;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        requestCv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+        if (requests_.empty()) {
+          return;
+        }
+        request = requests_.front();
+        requests_.pop_front();
+      }
+      const ssize_t result =
+          request.isWrite
+              ? ::pwrite(fd_, request.buf, request.length, request.offset)
+              : ::pread(fd_, request.buf, request.length, request.offset);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_.emplace_back(request.tag, result < 0 ? -errno : result);
+      }
+      doneCv_.notify_one();
+    }
+  }
+};
+
+} // namespace
+
+IoEmulator::IoEmulator(const IoEmulationConfig &config, uint32_t numSegments,
+                       uint32_t segmentSize, uint32_t pageSize)
+    : segmentSize_(segmentSize), pageSize_(pageSize),
+      queueDepth_(config.queueDepth) {
+  const auto &path = config.path;
+  const int flags = O_RDWR | O_CREAT;
+  if (config.directIo && pageSize % kAlignment == 0) {
+    fd_ = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    directIo_ = fd_ >= 0;
+  }
+  if (fd_ < 0) {
+    fd_ = ::open(path.c_str(), flags, 0644);
+  }
+  if (fd_ < 0) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+  const uint64_t fileSize = uint64_t{numSegments} * segmentSize;
+  if (::posix_fallocate(fd_, 0, fileSize) != 0 &&
+      ::ftruncate(fd_, fileSize) != 0) {
+    ::close(fd_);
+    throw std::runtime_error("Failed to preallocate file: " + path.string());
+  }
+
+  if (config.backend == IoEmulationConfig::Backend::kIoUring) {
+    backend_ = UringBackend::create(fd_, config.queueDepth);
+  }
+  if (!backend_) {
+    backend_ =
+        std::make_unique<ThreadPoolBackend>(fd_, std::max(1u, config.numThreads));
+  }
+
+  readBuffer_ = allocateBuffer(pageSize_);
+}
+
+IoEmulator::~IoEmulator() {
+  // The buffers freed below must outlive every request in flight. I/O
+  // errors surface through drain() at the end of the run; here they are
+  // only logged, as a destructor must not throw.
+  try {
+    while (numInFlight_ > 0) {
+      if (auto error = collect(true)) {
+        std::cerr << *error << std::endl;
+      }
+    }
+  } catch (const std::exception &e) {
+    // The backend itself failed: leak the buffers rather than free them
+    // under requests that may still be running.
+    std::cerr << e.what() << std::endl;
+    return;
+  }
+  backend_.reset();
+  ::close(fd_);
+  for (const auto &[segId, segment] : open_) {
+    std::free(segment.data);
+  }
+  std::free(readBuffer_);
+  for (char *buffer : freeBuffers_) {
+    std::free(buffer);
+  }
+}
+
+char *IoEmulator::allocateBuffer(size_t size) {
+  auto *buffer = static_cast<char *>(std::aligned_alloc(kAlignment, size));
+  if (buffer == nullptr) {
+    throw std::bad_alloc();
+  }
+  std::memset(buffer, 0, size);
+  return buffer;
+}
+
+char *IoEmulator::takeBuffer() {
+  while (freeBuffers_.empty() && writing_.size() >= kMaxSegmentsInFlight) {
+    reap(true);
+  }
+  if (freeBuffers_.empty()) {
+    return allocateBuffer(segmentSize_);
+  }
+  char *buffer = freeBuffers_.back();
+  freeBuffers_.pop_back();
+  std::memset(buffer, 0, segmentSize_);
+  return buffer;
+}
+
+void IoEmulator::append(uint32_t segId, uint32_t pageIdx,
+                        const std::string &key, uint32_t size,
+                        uint32_t expiryTime) {
+  auto [it, opened] = open_.try_emplace(segId);
+  auto &segment = it->second;
+  if (opened) {
+    segment.data = takeBuffer();
+    segment.pageOffsets.assign(segmentSize_ / pageSize_, 0);
+  }
+  assert(pageIdx < segment.pageOffsets.size());
+  uint32_t &offset = segment.pageOffsets[pageIdx];
+  assert(offset + kHeaderSize + size <= pageSize_);
+  char *record = segment.data + uint64_t{pageIdx} * pageSize_ + offset;
+  const uint64_t recordKey = recordKeyOf(key);
+  std::memcpy(record, &recordKey, sizeof(recordKey));
+  std::memcpy(record + 8, &size, sizeof(size));
+  std::memcpy(record + 12, &expiryTime, sizeof(expiryTime));
+  std::memset(record + kHeaderSize, static_cast<int>(recordKey & 0xff), size);
+  offset += kHeaderSize + size;
+}
+
+void IoEmulator::seal(uint32_t segId) {
+  auto it = open_.find(segId);
+  if (it == std::end(open_)) {
+    // Nothing was appended.
+    return;
+  }
+  // A tiny FIFO can come back to a segment before its last write is done.
+  while (numInFlight_ >= queueDepth_ || writing_.contains(segId)) {
+    reap(true);
+  }
+  SegmentBuffer buffer{.data = it->second.data,
+                       .segId = segId,
+                       .submitTime = Clock::now()};
+  open_.erase(it);
+  if (writing_.empty()) {
+    busySince_ = buffer.submitTime;
+  }
+  backend_->submit(true, buffer.data, segmentSize_,
+                   uint64_t{segId} * segmentSize_, segId);
+  numInFlight_++;
+  numSegmentWrites_++;
+  writing_[segId] = buffer;
+}
+
+void IoEmulator::read(uint32_t segId, uint32_t pageIdx,
+                      const std::string &key) {
+  const uint64_t pageOffset = uint64_t{pageIdx} * pageSize_;
+  const char *page = nullptr;
+  if (auto it = open_.find(segId); it != std::end(open_)) {
+    page = it->second.data + pageOffset;
+  } else if (auto it = writing_.find(segId); it != std::end(writing_)) {
+    page = it->second.data + pageOffset;
+  }
+  if (page != nullptr) {
+    numBufferedReads_++;
+    numVerifyFailures_ += !pageHoldsKey(page, key);
+    return;
+  }
+
+  while (numInFlight_ >= queueDepth_) {
+    reap(true);
+  }
+  const auto start = Clock::now();
+  readDone_ = false;
+  backend_->submit(false, readBuffer_, pageSize_,
+                   uint64_t{segId} * segmentSize_ + pageOffset, kReadTag);
+  numInFlight_++;
+  while (!readDone_) {
+    reap(true);
+  }
+  readLatency_.record(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start)
+          .count());
+  numPageReads_++;
+  numVerifyFailures_ += !pageHoldsKey(readBuffer_, key);
+}
+
+std::optional<std::string> IoEmulator::collect(bool wait) {
+  std::optional<std::string> error;
+  backend_->reap(wait, [&](uint64_t tag, int64_t result) {
+    numInFlight_--;
+    const uint32_t expected = tag == kReadTag ? pageSize_ : segmentSize_;
+    if (result != static_cast<int64_t>(expected) && !error) {
+      error = result < 0
+                  ? "Emulated flash I/O failed: " + errnoMessage(-result)
+                  : fmt::format("Short emulated flash I/O: {} of {} bytes",
+                                result, expected);
+    }
+    if (tag == kReadTag) {
+      readDone_ = true;
+      return;
+    }
+    auto it = writing_.find(tag);
+    assert(it != std::end(writing_));
+    const auto now = Clock::now();
+    writeLatency_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             now - it->second.submitTime)
+                             .count());
+    freeBuffers_.push_back(it->second.data);
+    writing_.erase(tag);
+    if (writing_.empty()) {
+      writeBusy_ += now - busySince_;
+    }
+  });
+  return error;
+}
+
+void IoEmulator::reap(bool wait) {
+  if (auto error = collect(wait)) {
+    throw std::runtime_error(*error);
+  }
+}
+
+void IoEmulator::drain() {
+  while (numInFlight_ > 0) {
+    reap(true);
+  }
+}
+
+bool IoEmulator::pageHoldsKey(const char *page, const std::string &key) const {
+  const uint64_t recordKey = recordKeyOf(key);
+  for (uint32_t offset = 0; offset + kHeaderSize <= pageSize_;) {
+    uint64_t storedKey;
+    uint32_t size;
+    std::memcpy(&storedKey, page + offset, sizeof(storedKey));
+    std::memcpy(&size, page + offset + 8, sizeof(size));
+    if (storedKey == 0) {
+      return false;
+    }
+    if (storedKey == recordKey) {
+      return true;
+    }
+    offset += kHeaderSize + size;
+  }
+  return false;
+}
+
+void IoEmulator::report(std::ostream &os) const {
+  const double writeSeconds = std::chrono::duration<double>(writeBusy_).count();
+  const double writtenMB =
+      static_cast<double>(numSegmentWrites_) * segmentSize_ / (1024 * 1024);
+  os << fmt::format("I/O emulation ({}{}): {} segment writes, {:.1f} MB at "
+                    "{:.1f} MB/s while writing; {} page reads, {} served from buffers, {} "
+                    "verification failures",
+                    backend_->name(), directIo_ ? ", O_DIRECT" : "",
+                    numSegmentWrites_, writtenMB,
+                    writeSeconds > 0 ? writtenMB / writeSeconds : 0.0,
+                    numPageReads_, numBufferedReads_, numVerifyFailures_)
+     << std::endl;
+  printHistogram(os, "segment write", writeLatency_);
+  printHistogram(os, "page read", readLatency_);
+}
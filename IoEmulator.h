@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "FunctionRef.h"
+#include "Histogram.h"
+#include "include/robin_hood.h"
+
+struct IoEmulationConfig {
+  enum class Backend { kIoUring, kThreadPool };
+
+  // Preallocated to the FIFO capacity.
+  std::filesystem::path path;
+  // kIoUring falls back to kThreadPool where io_uring is unavailable.
+  Backend backend{Backend::kIoUring};
+  uint32_t queueDepth{64};
+  uint32_t numThreads{8};
+  // Bypass the page cache; silently dropped on file systems without
+  // O_DIRECT (e.g. tmpfs) or page sizes that are not 4 KB multiples.
+  bool directIo{true};
+};
+
+// Asynchronous positional I/O on one file descriptor.
+class IoBackend {
+public:
+  using Completion = FunctionRef<void(uint64_t tag, int64_t result)>;
+
+  virtual ~IoBackend() = default;
+
+  // Never blocks; the caller bounds the number of requests in flight.
+  virtual void submit(bool isWrite, void *buf, uint32_t length,
+                      uint64_t offset, uint64_t tag) = 0;
+
+  // Hands every finished request to onDone; with wait, blocks until at
+  // least one has finished. result is the byte count or -errno.
+  virtual void reap(bool wait, Completion onDone) = 0;
+
+  virtual const char *name() const = 0;
+};
+
+// Real-I/O stand-in for the flash under Fifo. Items carry real bytes: each
+// is appended as a kMetadataSize header and its payload to the page Fifo
+// put it in, in an aligned buffer of its open segment. A sealed segment is
+// written to its slot of the file asynchronously; a FIFO hit reads its
+// page back synchronously and checks the item is there. Segments whose
+// write is still buffered or in flight are served from memory, as a real
+// cache would.
+class IoEmulator {
+public:
+  IoEmulator(const IoEmulationConfig &config, uint32_t numSegments,
+             uint32_t segmentSize, uint32_t pageSize);
+  ~IoEmulator();
+
+  IoEmulator(const IoEmulator &) = delete;
+  IoEmulator &operator=(const IoEmulator &) = delete;
+
+  // Opens segId on its first append; several segments may be open at once.
+  void append(uint32_t segId, uint32_t pageIdx, const std::string &key,
+              uint32_t size, uint32_t expiryTime);
+
+  // Writes the open segment segId to its slot of the file.
+  void seal(uint32_t segId);
+
+  void read(uint32_t segId, uint32_t pageIdx, const std::string &key);
+
+  // Waits for every write in flight.
+  void drain();
+
+  void report(std::ostream &os) const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct SegmentBuffer {
+    char *data{nullptr};
+    uint32_t segId{0};
+    Clock::time_point submitTime;
+  };
+
+  struct OpenSegment {
+    char *data{nullptr};
+    // Write cursor of every page.
+    std::vector<uint32_t> pageOffsets;
+  };
+
+  static constexpr uint64_t kReadTag = UINT64_MAX;
+  static constexpr uint32_t kMaxSegmentsInFlight = 4;
+
+  const uint32_t segmentSize_;
+  const uint32_t pageSize_;
+  const uint32_t queueDepth_;
+  int fd_{-1};
+  bool directIo_{false};
+  std::unique_ptr<IoBackend> backend_;
+
+  robin_hood::unordered_map<uint32_t, OpenSegment> open_;
+  // In flight, by tag (segment id).
+  robin_hood::unordered_map<uint64_t, SegmentBuffer> writing_;
+  std::vector<char *> freeBuffers_;
+  char *readBuffer_{nullptr};
+  uint32_t numInFlight_{0};
+  bool readDone_{false};
+
+  // Time with at least one segment write in flight.
+  Clock::time_point busySince_;
+  Clock::duration writeBusy_{0};
+  uint64_t numSegmentWrites_{0};
+  uint64_t numPageReads_{0};
+  uint64_t numBufferedReads_{0};
+  uint64_t numVerifyFailures_{0};
+  Histogram writeLatency_;
+  Histogram readLatency_;
+
+  char *allocateBuffer(size_t size);
+  char *takeBuffer();
+  // Accounts every finished request, then throws for the first failed one.
+  void reap(bool wait);
+  // As reap(), but returns the error instead of throwing it.
+  std::optional<std::string> collect(bool wait);
+  bool pageHoldsKey(const char *page, const std::string &key) const;
+};
@@ -0,0 +1,98 @@
+#include "MemoryResource.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "include/fmt/core.h"
+
+namespace {
+uintptr_t alignUp(uintptr_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+} // namespace
+
+HugePageArena::HugePageArena(size_t chunkSize)
+    : chunkSize_(alignUp(chunkSize, kHugePageSize)) {}
+
+HugePageArena::~HugePageArena() {
+  for (const auto &[addr, size] : chunks_) {
+    munmap(addr, size);
+  }
+}
+
+void HugePageArena::mapChunk(size_t minSize) {
+  const size_t size = std::max(chunkSize_, alignUp(minSize, kHugePageSize));
+  // Over-map by one huge page and trim both ends to get 2 MB alignment,
+  // which mmap does not guarantee.
+  const size_t mappedSize = size + kHugePageSize;
+  void *mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapped == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  const auto begin = reinterpret_cast<uintptr_t>(mapped);
+  const uintptr_t aligned = alignUp(begin, kHugePageSize);
+  if (aligned > begin) {
+    munmap(mapped, aligned - begin);
+  }
+  const uintptr_t tail = aligned + size;
+  if (begin + mappedSize > tail) {
+    munmap(reinterpret_cast<void *>(tail), begin + mappedSize - tail);
+  }
+  // Best effort: without transparent huge pages this is plain memory.
+  madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+
+  chunks_.emplace_back(reinterpret_cast<void *>(aligned), size);
+  cur_ = reinterpret_cast<char *>(aligned);
+  end_ = cur_ + size;
+  reservedBytes_ += size;
+}
+
+void *HugePageArena::do_allocate(size_t bytes, size_t alignment) {
+  auto p = alignUp(reinterpret_cast<uintptr_t>(cur_), alignment);
+  if (cur_ == nullptr || p + bytes > reinterpret_cast<uintptr_t>(end_)) {
+    // The rest of the current chunk is abandoned.
+    mapChunk(bytes + alignment);
+    p = alignUp(reinterpret_cast<uintptr_t>(cur_), alignment);
+  }
+  cur_ = reinterpret_cast<char *>(p + bytes);
+  usedBytes_ += bytes;
+  return reinterpret_cast<void *>(p);
+}
+
+void adviseMallocHugePages(char **argv) {
+  constexpr const char *kTunable = "glibc.malloc.hugetlb";
+  const char *tunables = std::getenv("GLIBC_TUNABLES");
+  if (tunables && std::strstr(tunables, kTunable)) {
+    return;
+  }
+  std::string value = tunables ? std::string(tunables) + ":" : "";
+  value += fmt::format("{}=1", kTunable);
+  setenv("GLIBC_TUNABLES", value.c_str(), 1);
+  execv("/proc/self/exe", argv);
+}
+
+uint64_t peakRssBytes() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+void printMemoryUsage(std::ostream &os, const std::vector<MemoryUsage> &usage) {
+  constexpr double kMB = 1024 * 1024;
+  os << "Memory (reserved / used MB, entries):" << std::endl;
+  for (const auto &table : usage) {
+    os << fmt::format("  {:<24} {:10.2f} / {:<10.2f} {}", table.table,
+                      table.reservedBytes / kMB, table.usedBytes / kMB,
+                      table.numEntries)
+       << std::endl;
+  }
+  os << fmt::format("  {:<24} {:10.2f}", "peak RSS", peakRssBytes() / kMB)
+     << std::endl;
+}
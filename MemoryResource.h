@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator over anonymous mappings that are 2 MB aligned and advised
+// MADV_HUGEPAGE, so that the large simulator tables are backed by huge
+// pages and their lookups do not thrash the TLB. Individual deallocations
+// are ignored; everything is unmapped when the arena is destroyed. Put a
+// pool in front of it for containers that free and reallocate.
+// Not thread-safe: every shard owns its own arena.
+class HugePageArena : public std::pmr::memory_resource {
+public:
+  static constexpr size_t kHugePageSize = 2 << 20;
+  static constexpr size_t kDefaultChunkSize = 16 * kHugePageSize;
+
+  explicit HugePageArena(size_t chunkSize = kDefaultChunkSize);
+  ~HugePageArena() override;
+
+  HugePageArena(const HugePageArena &) = delete;
+  HugePageArena &operator=(const HugePageArena &) = delete;
+
+  // Address space mapped so far, and the part of it handed out.
+  uint64_t reservedBytes() const { return reservedBytes_; }
+  uint64_t usedBytes() const { return usedBytes_; }
+
+private:
+  const size_t chunkSize_;
+  std::vector<std::pair<void *, size_t>> chunks_;
+  char *cur_{nullptr};
+  char *end_{nullptr};
+  uint64_t reservedBytes_{0};
+  uint64_t usedBytes_{0};
+
+  void mapChunk(size_t minSize);
+
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *, size_t, size_t) override {}
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+// Forwards to upstream and counts the bytes currently allocated through it.
+class CountingResource : public std::pmr::memory_resource {
+public:
+  explicit CountingResource(std::pmr::memory_resource *upstream)
+      : upstream_(upstream) {}
+
+  uint64_t bytes() const { return bytes_; }
+
+private:
+  std::pmr::memory_resource *upstream_;
+  uint64_t bytes_{0};
+
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    void *p = upstream_->allocate(bytes, alignment);
+    bytes_ += bytes;
+    return p;
+  }
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+    upstream_->deallocate(p, bytes, alignment);
+    bytes_ -= bytes;
+  }
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+// Memory of one table: a pool recycling freed blocks by size class on top
+// of a shared arena. Reserved bytes are what the pool holds from the
+// arena, used bytes what the table has live.
+class TablePool {
+public:
+  explicit TablePool(std::pmr::memory_resource *upstream)
+      : reserved_(upstream), pool_(&reserved_), used_(&pool_) {}
+
+  std::pmr::memory_resource *resource() { return &used_; }
+
+  uint64_t reservedBytes() const { return reserved_.bytes(); }
+  uint64_t usedBytes() const { return used_.bytes(); }
+
+private:
+  CountingResource reserved_;
+  std::pmr::unsynchronized_pool_resource pool_;
+  CountingResource used_;
+};
+
+// Estimated footprint of one table or buffer.
+struct MemoryUsage {
+  std::string table;
+  uint64_t reservedBytes{0};
+  uint64_t usedBytes{0};
+  uint64_t numEntries{0};
+};
+
+// robin_hood tables take no allocator, so they stay on malloc (see
+// adviseMallocHugePages) and their footprint is estimated from the slot count: one info byte per slot plus
+// the value inline (flat maps) or a pointer to an out-of-line node (node
+// maps). Heap bytes of long keys are not included.
+template <typename Map>
+void addTableUsage(MemoryUsage &usage, const Map &map) {
+  constexpr uint64_t kSlotBytes =
+      1 + (Map::is_flat ? sizeof(typename Map::value_type) : sizeof(void *));
+  constexpr uint64_t kNodeBytes =
+      Map::is_flat ? 0 : sizeof(typename Map::value_type);
+  const uint64_t numSlots = map.empty() ? 0 : map.mask() + 1;
+  usage.reservedBytes += numSlots * kSlotBytes + map.size() * kNodeBytes;
+  usage.usedBytes += map.size() * (kSlotBytes + kNodeBytes);
+  usage.numEntries += map.size();
+}
+
+// Element buffers of a container of vectors, e.g. per-key histories.
+template <typename Map>
+void addNestedVectorUsage(MemoryUsage &usage, const Map &map) {
+  for (const auto &[key, values] : map) {
+    using Value = typename std::decay_t<decltype(values)>::value_type;
+    usage.reservedBytes += values.capacity() * sizeof(Value);
+    usage.usedBytes += values.size() * sizeof(Value);
+    usage.numEntries += values.size();
+  }
+}
+
+// Gets malloc, and so the robin_hood tables the arena cannot back, onto
+// huge pages: glibc 2.35+ advises its heap and mappings MADV_HUGEPAGE with
+// the glibc.malloc.hugetlb tunable. Tunables are only read at startup, so
+// this re-executes the process with it set, unless GLIBC_TUNABLES already
+// chooses. Call before starting threads or writing output. Returns if the
+// exec fails; older glibc ignores the tunable.
+void adviseMallocHugePages(char **argv);
+
+// Peak resident set size of the process so far.
+uint64_t peakRssBytes();
+
+// One line per table with reserved and used MB and the entry count,
+// followed by the process peak RSS.
+void printMemoryUsage(std::ostream &os, const std::vector<MemoryUsage> &usage);
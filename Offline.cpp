@@ -0,0 +1,376 @@
+#include "Offline.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <functional>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "include/fmt/core.h"
+
+namespace {
+
+// Number of records read or written per block by the streaming passes.
+constexpr uint64_t kBlockRecords = 1 << 20;
+// Requests between two samples of the FIFO write rate.
+constexpr uint64_t kWriteRateWindow = 1 << 16;
+
+int openFile(const std::filesystem::path &path, int flags) {
+  int fd = ::open(path.c_str(), flags, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+  return fd;
+}
+
+void readAt(int fd, void *buf, size_t len, uint64_t offset) {
+  auto *p = static_cast<char *>(buf);
+  while (len > 0) {
+    ssize_t n = ::pread(fd, p, len, offset);
+    if (n <= 0) {
+      throw std::runtime_error("Short read from offline spill file");
+    }
+    p += n;
+    len -= n;
+    offset += n;
+  }
+}
+
+void writeAt(int fd, const void *buf, size_t len, uint64_t offset) {
+  const auto *p = static_cast<const char *>(buf);
+  while (len > 0) {
+    ssize_t n = ::pwrite(fd, p, len, offset);
+    if (n <= 0) {
+      throw std::runtime_error("Short write to offline spill file");
+    }
+    p += n;
+    len -= n;
+    offset += n;
+  }
+}
+
+// Sequential block reader over a file of fixed-size T.
+template <typename T> class BlockReader {
+public:
+  BlockReader(const std::filesystem::path &path, uint64_t numRecords)
+      : fd(openFile(path, O_RDONLY)), numRecords(numRecords) {
+    buffer.resize(kBlockRecords);
+  }
+  ~BlockReader() { ::close(fd); }
+
+  const T &next() {
+    if (pos == filled) {
+      base += filled;
+      filled = std::min(kBlockRecords, numRecords - base);
+      readAt(fd, buffer.data(), filled * sizeof(T), base * sizeof(T));
+      pos = 0;
+    }
+    return buffer[pos++];
+  }
+
+private:
+  int fd;
+  const uint64_t numRecords;
+  std::vector<T> buffer;
+  uint64_t base{0};
+  uint64_t pos{0};
+  uint64_t filled{0};
+};
+
+std::string keyOf(uint64_t keyHash) { return fmt::format("{:016x}", keyHash); }
+
+} // namespace
+
+uint64_t decodeTrace(Trace &trace, const std::filesystem::path &recordsFile) {
+  int fd = openFile(recordsFile, O_WRONLY | O_CREAT | O_TRUNC);
+  std::vector<OfflineRecord> block;
+  block.reserve(kBlockRecords);
+  uint64_t numRecords = 0;
+
+  auto flush = [&] {
+    writeAt(fd, block.data(), block.size() * sizeof(OfflineRecord),
+            (numRecords - block.size()) * sizeof(OfflineRecord));
+    block.clear();
+  };
+
+  Trace::Entry e;
+  while (trace.nextRequest(e)) {
+    block.push_back({.keyHash = std::hash<std::string>{}(e.key),
+                     .size = e.size,
+                     .op = e.op,
+                     .pad = {}});
+    numRecords++;
+    if (block.size() == kBlockRecords) {
+      flush();
+    }
+  }
+  flush();
+  ::close(fd);
+  return numRecords;
+}
+
+void computeNextAccess(const std::filesystem::path &recordsFile,
+                       uint64_t numRecords,
+                       const std::filesystem::path &nextAccessFile) {
+  int in = openFile(recordsFile, O_RDONLY);
+  int out = openFile(nextAccessFile, O_WRONLY | O_CREAT | O_TRUNC);
+  std::vector<OfflineRecord> records(kBlockRecords);
+  std::vector<uint64_t> nextAccess(kBlockRecords);
+  // Index of the next GET of each key that is still a hit, i.e. not
+  // preceded by a SET or DELETE of the key.
+  robin_hood::unordered_map<uint64_t, uint64_t> nextGet;
+
+  uint64_t end = numRecords;
+  while (end > 0) {
+    const uint64_t begin = end - std::min(kBlockRecords, end);
+    const uint64_t n = end - begin;
+    readAt(in, records.data(), n * sizeof(OfflineRecord),
+           begin * sizeof(OfflineRecord));
+
+    for (uint64_t i = n; i-- > 0;) {
+      const auto &record = records[i];
+      auto [it, inserted] = nextGet.try_emplace(record.keyHash, kNeverAccessed);
+      nextAccess[i] = it->second;
+      it->second = record.op == Op::kGet ? begin + i : kNeverAccessed;
+    }
+
+    writeAt(out, nextAccess.data(), n * sizeof(uint64_t),
+            begin * sizeof(uint64_t));
+    end = begin;
+  }
+
+  ::close(in);
+  ::close(out);
+}
+
+bool BeladyCache::isCurrent(const std::pair<uint64_t, uint64_t> &entry) const {
+  auto it = items.find(entry.second);
+  return it != std::end(items) && it->second.nextAccess == entry.first;
+}
+
+void BeladyCache::compactHeap() {
+  std::vector<std::pair<uint64_t, uint64_t>> live;
+  live.reserve(items.size());
+  for (const auto &[key, item] : items) {
+    live.emplace_back(item.nextAccess, key);
+  }
+  byNextAccess = decltype(byNextAccess)(decltype(byNextAccess)::value_compare(),
+                                        std::move(live));
+}
+
+bool BeladyCache::lookup(uint64_t key, uint64_t nextAccess) {
+  stat.numDramAccesses++;
+
+  auto it = items.find(key);
+  if (it == std::end(items)) {
+    return false;
+  }
+  stat.numDramHits++;
+
+  // MIN would evict it first anyway; dropping it now also keeps a single
+  // heap entry per key at kNeverAccessed.
+  if (nextAccess == kNeverAccessed) {
+    freeCapacity += it->second.size;
+    items.erase(key);
+    return true;
+  }
+  it->second.nextAccess = nextAccess;
+  byNextAccess.emplace(nextAccess, key);
+  if (byNextAccess.size() > 2 * items.size() + 1024) {
+    compactHeap();
+  }
+  return true;
+}
+
+void BeladyCache::insert(const Item &item, std::vector<Item> &victims) {
+  remove(item.key);
+  if (item.size > capacity || item.nextAccess == kNeverAccessed) {
+    victims.push_back(item);
+    return;
+  }
+
+  // Collect the furthest-reused items until the new one fits. If one of
+  // them is reused sooner than the new item, MIN keeps them all instead.
+  std::vector<std::pair<uint64_t, uint64_t>> candidates;
+  uint64_t reclaimable = freeCapacity;
+  bool bypass = false;
+  while (reclaimable < item.size) {
+    auto top = byNextAccess.top();
+    byNextAccess.pop();
+    if (!isCurrent(top)) {
+      continue;
+    }
+    candidates.push_back(top);
+    if (top.first < item.nextAccess) {
+      bypass = true;
+      break;
+    }
+    reclaimable += items.at(top.second).size;
+  }
+
+  if (bypass) {
+    for (const auto &candidate : candidates) {
+      byNextAccess.push(candidate);
+    }
+    victims.push_back(item);
+    return;
+  }
+
+  for (const auto &candidate : candidates) {
+    const auto &victim = items.at(candidate.second);
+    victims.push_back(victim);
+    freeCapacity += victim.size;
+    items.erase(candidate.second);
+  }
+
+  items[item.key] = item;
+  byNextAccess.emplace(item.nextAccess, item.key);
+  freeCapacity -= item.size;
+}
+
+void BeladyCache::remove(uint64_t key) {
+  // The heap entry goes stale and is skipped when it surfaces.
+  if (auto it = items.find(key); it != std::end(items)) {
+    freeCapacity += it->second.size;
+    items.erase(key);
+  }
+}
+
+void runOfflineOpt(Trace &trace, const OfflineOptConfig &config,
+                   std::ostream &log) {
+  const auto recordsFile = config.workDir / "opt.records";
+  const auto nextAccessFile = config.workDir / "opt.next";
+
+  const uint64_t numRecords = decodeTrace(trace, recordsFile);
+  std::cout << fmt::format("OPT: decoded {} requests", numRecords)
+            << std::endl;
+  computeNextAccess(recordsFile, numRecords, nextAccessFile);
+
+  Stat stat;
+  Clock clock;
+  BeladyCache dram(stat, config.dramSize);
+  auto fifo = Fifo::create(stat, clock, config.fifoSize, config.overwrittenLog,
+                           config.overwrittenAccLog, config.segmentSize,
+                           config.pageSize);
+
+  uint64_t numRejected = 0;
+  uint64_t numNeverReused = 0;
+  double writeRate = 0; // FIFO bytes written per request
+  uint64_t prevWriteBytes = 0;
+
+  std::vector<BeladyCache::Item> victims;
+  auto insert = [&](uint64_t now, const BeladyCache::Item &item) {
+    victims.clear();
+    dram.insert(item, victims);
+    for (const auto &victim : victims) {
+      if (victim.isInFifo) {
+        continue;
+      }
+      if (victim.nextAccess == kNeverAccessed) {
+        numNeverReused++;
+        continue;
+      }
+      // Requests until the write head comes back around to this item.
+      if (writeRate > 0 &&
+          victim.nextAccess - now > config.fifoSize / writeRate) {
+        numRejected++;
+        continue;
+      }
+      fifo->insert({.key = keyOf(victim.key),
+                    .size = victim.size,
+                    .numAccesses = 0,
+                    .isInFifo = false,
+                    .expiryTime = 0});
+    }
+  };
+
+  log << "numAccess,numHit,numDramAccess,numDramHit,numFifoAccess,numFifoHit,"
+         "numFifoOverWrittenHits,numFifoWrite,fifoWriteBytes,"
+         "numAdmissionRejected,numNeverReused"
+      << std::endl;
+  auto printStat = [&](const Stat &mid) {
+    std::cout << fmt::format(
+                     "OPT miss ratio: {:.2f}, DRAM miss ratio: {:.2f}",
+                     static_cast<double>(mid.numAccesses - mid.numHits) /
+                         mid.numAccesses * 100.0,
+                     static_cast<double>(mid.numDramAccesses -
+                                         mid.numDramHits) /
+                         mid.numDramAccesses * 100.0)
+              << std::endl;
+    log << fmt::format("{},{},{},{},{},{},{},{},{},{},{}", stat.numAccesses,
+                       stat.numHits, stat.numDramAccesses, stat.numDramHits,
+                       stat.numFifoAccesses, stat.numFifoHits,
+                       stat.numFifoOverWrittenHits, stat.numFifoWrites,
+                       stat.fifoWriteBytes, numRejected, numNeverReused)
+        << std::endl;
+  };
+
+  BlockReader<OfflineRecord> records(recordsFile, numRecords);
+  BlockReader<uint64_t> nextAccesses(nextAccessFile, numRecords);
+  Stat prevStat;
+  uint64_t numGets = 0;
+  for (uint64_t now = 0; now < numRecords; ++now) {
+    const auto &record = records.next();
+    const uint64_t nextAccess = nextAccesses.next();
+
+    if (numGets % config.statPrintInterval == 0 && numGets > 0 &&
+        stat.numAccesses != prevStat.numAccesses) {
+      printStat(stat - prevStat);
+      prevStat = stat;
+    }
+    if (now % kWriteRateWindow == 0 && now > 0) {
+      const double rate =
+          static_cast<double>(stat.fifoWriteBytes - prevWriteBytes) /
+          kWriteRateWindow;
+      writeRate = writeRate == 0 ? rate : (writeRate + rate) / 2;
+      prevWriteBytes = stat.fifoWriteBytes;
+    }
+
+    const BeladyCache::Item item{.key = record.keyHash,
+                                 .size = record.size,
+                                 .nextAccess = nextAccess,
+                                 .isInFifo = false};
+    switch (record.op) {
+    case Op::kDelete:
+      stat.numRemoved++;
+      dram.remove(record.keyHash);
+      fifo->remove(keyOf(record.keyHash));
+      break;
+    case Op::kSet:
+      stat.numSets++;
+      if (fifo->remove(keyOf(record.keyHash))) {
+        stat.numFifoInvalidations++;
+      }
+      insert(now, item);
+      break;
+    default:
+      numGets++;
+      stat.numAccesses++;
+      if (dram.lookup(record.keyHash, nextAccess)) {
+        stat.numHits++;
+      } else if (auto hit = fifo->lookup(keyOf(record.keyHash))) {
+        stat.numHits++;
+        insert(now, {.key = record.keyHash,
+                     .size = hit->size,
+                     .nextAccess = nextAccess,
+                     .isInFifo = true});
+      } else {
+        insert(now, item);
+      }
+      break;
+    }
+  }
+  printStat(stat - prevStat);
+  std::cout << fmt::format("OPT total: miss ratio {:.2f}, {} FIFO writes ({} "
+                           "bytes), {} rejected by admission, {} never reused",
+                           static_cast<double>(stat.numAccesses -
+                                               stat.numHits) /
+                               stat.numAccesses * 100.0,
+                           stat.numFifoWrites, stat.fifoWriteBytes,
+                           numRejected, numNeverReused)
+            << std::endl;
+
+  std::filesystem::remove(recordsFile);
+  std::filesystem::remove(nextAccessFile);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "Clock.h"
+#include "Trace.h"
+#include "fifo.h"
+#include "include/robin_hood.h"
+#include "stat.h"
+
+// Offline (oracle) bounds. The trace is first decoded once into a compact
+// spill file of fixed-size records; a reverse pass over that file then
+// computes, for every request, the index of the next request that can hit
+// the same object. Both passes stream the files in blocks, so memory is
+// O(distinct keys) rather than O(requests).
+struct OfflineRecord {
+  uint64_t keyHash;
+  uint32_t size;
+  Op op;
+  uint8_t pad[3];
+};
+static_assert(sizeof(OfflineRecord) == 16);
+
+// Next-access value of requests whose object is never hit again: it is
+// not requested again, or is deleted or overwritten first.
+constexpr uint64_t kNeverAccessed = UINT64_MAX;
+
+// Decodes the trace into recordsFile and returns the number of records.
+uint64_t decodeTrace(Trace &trace, const std::filesystem::path &recordsFile);
+
+// Writes one uint64_t per record to nextAccessFile: the index of the next
+// GET of the same key, or kNeverAccessed if a SET/DELETE comes first.
+void computeNextAccess(const std::filesystem::path &recordsFile,
+                       uint64_t numRecords,
+                       const std::filesystem::path &nextAccessFile);
+
+// Belady's MIN for a byte-capacity cache: evicts the objects whose next
+// access is furthest in the future until the new object fits, and bypasses
+// the new object instead when it would itself be the first to go.
+class BeladyCache {
+public:
+  struct Item {
+    uint64_t key;
+    uint32_t size;
+    uint64_t nextAccess;
+    bool isInFifo;
+  };
+
+  BeladyCache(Stat &stat, uint64_t capacity)
+      : stat(stat), capacity(capacity), freeCapacity(capacity) {}
+
+  bool lookup(uint64_t key, uint64_t nextAccess);
+
+  // Evicted items, or the new item itself if it was bypassed, are appended
+  // to victims.
+  void insert(const Item &item, std::vector<Item> &victims);
+
+  void remove(uint64_t key);
+
+private:
+  Stat &stat;
+  const uint64_t capacity;
+  uint64_t freeCapacity;
+
+  robin_hood::unordered_map<uint64_t, Item> items;
+  // (nextAccess, key), max first. Entries are invalidated lazily.
+  std::priority_queue<std::pair<uint64_t, uint64_t>> byNextAccess;
+
+  bool isCurrent(const std::pair<uint64_t, uint64_t> &entry) const;
+  void compactHeap();
+};
+
+struct OfflineOptConfig {
+  uint64_t dramSize;
+  uint64_t fifoSize;
+  uint32_t segmentSize;
+  uint32_t pageSize;
+  std::string overwrittenLog;
+  std::string overwrittenAccLog;
+  std::filesystem::path workDir;
+  uint64_t statPrintInterval;
+};
+
+// Replays the trace with Belady's MIN in DRAM and an oracle flash admission
+// policy: a DRAM victim is written to the FIFO only if its next access is
+// predicted to come before the FIFO wraps around and overwrites it. The
+// wrap horizon is estimated from the recent FIFO write rate.
+void runOfflineOpt(Trace &trace, const OfflineOptConfig &config,
+                   std::ostream &log);
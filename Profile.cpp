@@ -0,0 +1,196 @@
+#include "Profile.h"
+
+#ifdef SIM_PROFILE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+#include "include/fmt/core.h"
+
+namespace {
+
+constexpr uint32_t kMaxThreads = 256;
+constexpr std::array<const char *, static_cast<int>(ProfilePhase::kNumPhases)>
+    kPhaseNames = {"trace_parse",  "dram_lookup",   "dram_insert",
+                   "fifo_lookup",  "fifo_insert",   "segment_clear",
+                   "log_format"};
+
+// Slots are never freed; threads beyond kMaxThreads share the last one.
+std::array<ProfileSlot, kMaxThreads> slots{};
+std::atomic<uint32_t> numSlots{0};
+
+// A snapshot of the slots, summed over threads.
+struct ProfileTotals {
+  uint64_t cycles[static_cast<int>(ProfilePhase::kNumPhases)];
+  uint64_t calls[static_cast<int>(ProfilePhase::kNumPhases)];
+  uint64_t counters[static_cast<int>(ProfileCounter::kNumCounters)];
+};
+
+ProfileTotals lastReport{};
+
+ProfileTotals sumSlots() {
+  constexpr auto kRelaxed = std::memory_order_relaxed;
+  ProfileTotals sum{};
+  const uint32_t n = std::min(numSlots.load(), kMaxThreads);
+  for (uint32_t i = 0; i < n; ++i) {
+    for (int p = 0; p < static_cast<int>(ProfilePhase::kNumPhases); ++p) {
+      sum.cycles[p] += slots[i].cycles[p].load(kRelaxed);
+      sum.calls[p] += slots[i].calls[p].load(kRelaxed);
+    }
+    for (int c = 0; c < static_cast<int>(ProfileCounter::kNumCounters); ++c) {
+      const uint64_t value = slots[i].counters[c].load(kRelaxed);
+      const bool isMax =
+          c == static_cast<int>(ProfileCounter::kMaxDramVictims) ||
+          c == static_cast<int>(ProfileCounter::kMaxSegmentClearVictims);
+      sum.counters[c] =
+          isMax ? std::max(sum.counters[c], value) : sum.counters[c] + value;
+    }
+  }
+  return sum;
+}
+
+// Cycle counter ticks per nanosecond, measured once.
+double ticksPerNs() {
+  static const double ratio = [] {
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t startTicks = profileCycles();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    const uint64_t ticks = profileCycles() - startTicks;
+    const auto ns = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    return ticks / ns;
+  }();
+  return ratio;
+}
+
+// Counts the allocation; 0 alignment: malloc's default. Never recurses:
+// profileSlot() does not allocate.
+void *allocate(size_t n, size_t alignment) {
+  PROFILE_COUNT(kAllocations, 1);
+  n = n ? n : 1;
+  void *p = nullptr;
+  if (alignment == 0) {
+    p = std::malloc(n);
+  } else if (posix_memalign(&p, std::max(alignment, sizeof(void *)), n) != 0) {
+    p = nullptr;
+  }
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+} // namespace
+
+// Heap allocations of every binary built with the profiler are counted
+// here. The aligned forms matter: std::pmr::new_delete_resource, which
+// backs the DRAM LRU, allocates through them. Everything is released by
+// the unsized delete.
+void *operator new(size_t n) { return allocate(n, 0); }
+
+void *operator new(size_t n, std::align_val_t alignment) {
+  return allocate(n, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t n) { return ::operator new(n); }
+
+void *operator new[](size_t n, std::align_val_t alignment) {
+  return ::operator new(n, alignment);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { ::operator delete(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept {
+  ::operator delete(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  ::operator delete(p);
+}
+
+void operator delete[](void *p) noexcept { ::operator delete(p); }
+
+void operator delete[](void *p, size_t) noexcept { ::operator delete(p); }
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+  ::operator delete(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  ::operator delete(p);
+}
+
+thread_local ProfileScope *ProfileScope::current_ = nullptr;
+
+ProfileSlot &profileSlot() {
+  thread_local ProfileSlot *slot = nullptr;
+  if (!slot) {
+    slot = &slots[std::min(numSlots.fetch_add(1), kMaxThreads - 1)];
+  }
+  return *slot;
+}
+
+void profileReport(std::ostream &os, bool cumulative) {
+  const ProfileTotals cur = sumSlots();
+  ProfileTotals delta = cur;
+  if (!cumulative) {
+    for (int p = 0; p < static_cast<int>(ProfilePhase::kNumPhases); ++p) {
+      delta.cycles[p] -= lastReport.cycles[p];
+      delta.calls[p] -= lastReport.calls[p];
+    }
+    for (int c = 0; c < static_cast<int>(ProfileCounter::kNumCounters); ++c) {
+      delta.counters[c] -= lastReport.counters[c];
+    }
+    // Maxima are reported since the start of the run.
+    delta.counters[static_cast<int>(ProfileCounter::kMaxDramVictims)] =
+        cur.counters[static_cast<int>(ProfileCounter::kMaxDramVictims)];
+    delta.counters[static_cast<int>(ProfileCounter::kMaxSegmentClearVictims)] =
+        cur.counters[static_cast<int>(
+            ProfileCounter::kMaxSegmentClearVictims)];
+    lastReport = cur;
+  }
+
+  auto counter = [&](ProfileCounter c) {
+    return delta.counters[static_cast<int>(c)];
+  };
+  const double numRequests =
+      std::max<uint64_t>(counter(ProfileCounter::kRequests), 1);
+  const double nsPerTick = 1 / ticksPerNs();
+
+  os << fmt::format("Profile ({}, {} requests, self ns/request):",
+                    cumulative ? "total" : "interval",
+                    counter(ProfileCounter::kRequests));
+  for (int p = 0; p < static_cast<int>(ProfilePhase::kNumPhases); ++p) {
+    if (delta.calls[p] > 0) {
+      os << fmt::format(" {} {:.1f}", kPhaseNames[p],
+                        delta.cycles[p] * nsPerTick / numRequests);
+    }
+  }
+  os << std::endl;
+
+  const auto dramInserts =
+      delta.calls[static_cast<int>(ProfilePhase::kDramInsert)];
+  const auto segmentClears = counter(ProfileCounter::kSegmentClears);
+  os << fmt::format(
+            "Profile victims: dram {:.2f}/insert (max {}), segment clear "
+            "{:.1f}/clear (max {}); allocations {:.2f}/request (all "
+            "threads)",
+            static_cast<double>(counter(ProfileCounter::kDramVictims)) /
+                std::max<uint64_t>(dramInserts, 1),
+            counter(ProfileCounter::kMaxDramVictims),
+            static_cast<double>(counter(ProfileCounter::kSegmentClearVictims)) /
+                std::max<uint64_t>(segmentClears, 1),
+            counter(ProfileCounter::kMaxSegmentClearVictims),
+            counter(ProfileCounter::kAllocations) / numRequests)
+     << std::endl;
+}
+
+#endif
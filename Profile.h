@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// Cycle-counter instrumentation of the replay hot paths. Compiled in with
+// -DSIM_PROFILE; otherwise the macros expand to empty statements and no
+// code is generated.
+//
+// Each thread accumulates into its own fixed slot, so shard threads do not
+// contend. Only the owner writes a slot, with relaxed atomics, so reports
+// can read them while helper threads run; the shards are idle at the sync
+// points reports are taken at.
+//
+// Scopes nest (a DRAM insert cascades into FIFO inserts and segment
+// clears), so each phase records its self time: the time of the scopes
+// nested in it is left out, and the phases add up to the time measured.
+
+enum class ProfilePhase : uint8_t {
+  kTraceParse,
+  kDramLookup,
+  kDramInsert,
+  kFifoLookup,
+  kFifoInsert,
+  kSegmentClear,
+  kLogFormat,
+  kNumPhases,
+};
+
+enum class ProfileCounter : uint8_t {
+  kRequests,
+  kDramVictims,
+  kMaxDramVictims,
+  kSegmentClears,
+  kSegmentClearVictims,
+  kMaxSegmentClearVictims,
+  kAllocations,
+  kNumCounters,
+};
+
+#ifdef SIM_PROFILE
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint64_t profileCycles() { return __rdtsc(); }
+#else
+#include <chrono>
+inline uint64_t profileCycles() {
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+#endif
+
+struct ProfileSlot {
+  std::atomic<uint64_t> cycles[static_cast<int>(ProfilePhase::kNumPhases)];
+  std::atomic<uint64_t> calls[static_cast<int>(ProfilePhase::kNumPhases)];
+  std::atomic<uint64_t>
+      counters[static_cast<int>(ProfileCounter::kNumCounters)];
+};
+
+// Only the owning thread writes, so a plain load and store is enough.
+inline void profileAdd(std::atomic<uint64_t> &value, uint64_t n) {
+  value.store(value.load(std::memory_order_relaxed) + n,
+              std::memory_order_relaxed);
+}
+
+// The calling thread's slot. Never allocates, so it is safe to use from
+// operator new.
+ProfileSlot &profileSlot();
+
+class ProfileScope {
+public:
+  explicit ProfileScope(ProfilePhase phase)
+      : phase_(static_cast<int>(phase)), parent_(current_),
+        start_(profileCycles()) {
+    current_ = this;
+  }
+  ~ProfileScope() {
+    const uint64_t elapsed = profileCycles() - start_;
+    auto &slot = profileSlot();
+    profileAdd(slot.cycles[phase_], elapsed - childCycles_);
+    profileAdd(slot.calls[phase_], 1);
+    if (parent_) {
+      parent_->childCycles_ += elapsed;
+    }
+    current_ = parent_;
+  }
+
+private:
+  // The innermost open scope of the calling thread.
+  static thread_local ProfileScope *current_;
+
+  const int phase_;
+  ProfileScope *const parent_;
+  const uint64_t start_;
+  uint64_t childCycles_{0};
+};
+
+inline void profileCount(ProfileCounter counter, uint64_t n) {
+  profileAdd(profileSlot().counters[static_cast<int>(counter)], n);
+}
+
+inline void profileMax(ProfileCounter counter, uint64_t n) {
+  auto &value = profileSlot().counters[static_cast<int>(counter)];
+  if (n > value.load(std::memory_order_relaxed)) {
+    value.store(n, std::memory_order_relaxed);
+  }
+}
+
+// Prints the breakdown since the previous interval report, or the totals
+// of the whole run with cumulative set.
+void profileReport(std::ostream &os, bool cumulative);
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase)                                                   \
+  ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(ProfilePhase::phase)
+#define PROFILE_COUNT(counter, n) profileCount(ProfileCounter::counter, (n))
+#define PROFILE_MAX(counter, n) profileMax(ProfileCounter::counter, (n))
+#define PROFILE_REPORT(os, cumulative) profileReport((os), (cumulative))
+
+#else
+
+#define PROFILE_SCOPE(phase)                                                   \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_COUNT(counter, n)                                              \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_MAX(counter, n)                                                \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_REPORT(os, cumulative)                                         \
+  do {                                                                         \
+  } while (0)
+
+#endif
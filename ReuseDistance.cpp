@@ -0,0 +1,259 @@
+#include "ReuseDistance.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+#include "include/fmt/core.h"
+
+namespace {
+
+constexpr std::array<const char *, 3> kOpNames = {"get", "set", "delete"};
+
+} // namespace
+
+void FenwickTree::reset(const std::vector<uint64_t> &values) {
+  const uint64_t n = values.size();
+  tree_.assign(n + 1, 0);
+  for (uint64_t i = 1; i <= n; ++i) {
+    tree_[i] += values[i - 1];
+    if (uint64_t parent = i + (i & -i); parent <= n) {
+      tree_[parent] += tree_[i];
+    }
+  }
+}
+
+void FenwickTree::add(uint64_t pos, uint64_t delta) {
+  for (uint64_t i = pos + 1; i < tree_.size(); i += i & -i) {
+    tree_[i] += delta;
+  }
+}
+
+uint64_t FenwickTree::prefix(uint64_t pos) const {
+  uint64_t sum = 0;
+  for (uint64_t i = pos; i > 0; i -= i & -i) {
+    sum += tree_[i];
+  }
+  return sum;
+}
+
+ReuseDistanceAnalyzer::ReuseDistanceAnalyzer() {
+  objectMarks_.reset(std::vector<uint64_t>(kMinPositions));
+  byteMarks_.reset(std::vector<uint64_t>(kMinPositions));
+  pending_.reserve(kBatchSize);
+  thread_ = std::thread([this] { run(); });
+}
+
+ReuseDistanceAnalyzer::~ReuseDistanceAnalyzer() {
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+}
+
+uint32_t ReuseDistanceAnalyzer::sizeClassOf(uint32_t size) {
+  return std::lower_bound(std::begin(kSizeClassBounds),
+                          std::end(kSizeClassBounds), size) -
+         std::begin(kSizeClassBounds);
+}
+
+void ReuseDistanceAnalyzer::access(const TraceEntry &e) {
+  pending_.push_back({.keyHash = std::hash<std::string>{}(e.key),
+                      .size = e.size,
+                      .op = e.op});
+  if (pending_.size() == kBatchSize) {
+    submit();
+  }
+}
+
+void ReuseDistanceAnalyzer::submit() {
+  std::vector<Access> next;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return queue_.size() < kMaxQueuedBatches; });
+    queue_.push_back(std::move(pending_));
+    if (!freeBatches_.empty()) {
+      next = std::move(freeBatches_.back());
+      freeBatches_.pop_back();
+    }
+  }
+  cv_.notify_all();
+  next.reserve(kBatchSize);
+  pending_ = std::move(next);
+}
+
+void ReuseDistanceAnalyzer::appendMemoryUsage(
+    std::vector<MemoryUsage> &usage) {
+  MemoryUsage batches{.table = "analytics.reuse-batches"};
+  batches.reservedBytes += pending_.capacity() * sizeof(Access);
+  batches.usedBytes += pending_.size() * sizeof(Access);
+  batches.numEntries += pending_.size();
+  std::lock_guard<std::mutex> lock(mutex_);
+  usage.push_back(stateUsage_);
+  for (const auto &batch : queue_) {
+    batches.reservedBytes += batch.capacity() * sizeof(Access);
+    batches.usedBytes += batch.size() * sizeof(Access);
+    batches.numEntries += batch.size();
+  }
+  for (const auto &batch : freeBatches_) {
+    batches.reservedBytes += batch.capacity() * sizeof(Access);
+  }
+  usage.push_back(batches);
+}
+
+void ReuseDistanceAnalyzer::run() {
+  while (true) {
+    std::vector<Access> batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [&] { return !queue_.empty() || stop_; });
+      if (queue_.empty()) {
+        return;
+      }
+      batch = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    cv_.notify_all();
+
+    for (const auto &access : batch) {
+      analyze(access);
+    }
+
+    batch.clear();
+    MemoryUsage stateUsage{.table = "analytics.reuse-distance"};
+    addTableUsage(stateUsage, lastAccess_);
+    const uint64_t markBytes =
+        2 * (objectMarks_.size() + 1) * sizeof(uint64_t);
+    stateUsage.reservedBytes += markBytes;
+    stateUsage.usedBytes += markBytes;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      freeBatches_.push_back(std::move(batch));
+      stateUsage_ = std::move(stateUsage);
+    }
+  }
+}
+
+void ReuseDistanceAnalyzer::analyze(const Access &access) {
+  // The simulator replays anything else as a GET.
+  const uint32_t op =
+      access.op == Op::kOther ? 0 : static_cast<uint32_t>(access.op);
+  auto &histograms = histograms_[op][sizeClassOf(access.size)];
+
+  if (nextPos_ == objectMarks_.size()) {
+    compact();
+  }
+
+  auto it = lastAccess_.find(access.keyHash);
+  if (it == std::end(lastAccess_)) {
+    histograms.numCold++;
+    if (access.op == Op::kDelete) {
+      return;
+    }
+  } else {
+    // Every mark after the previous access belongs to a distinct key.
+    const uint64_t pos = it->second.pos;
+    histograms.objects.record(objectMarks_.prefix(nextPos_) -
+                              objectMarks_.prefix(pos + 1));
+    histograms.bytes.record(byteMarks_.prefix(nextPos_) -
+                            byteMarks_.prefix(pos + 1));
+    objectMarks_.add(pos, -1);
+    byteMarks_.add(pos, -static_cast<uint64_t>(it->second.size));
+    if (access.op == Op::kDelete) {
+      lastAccess_.erase(access.keyHash);
+      return;
+    }
+  }
+
+  lastAccess_[access.keyHash] = {.pos = nextPos_, .size = access.size};
+  objectMarks_.add(nextPos_, 1);
+  byteMarks_.add(nextPos_, access.size);
+  nextPos_++;
+}
+
+void ReuseDistanceAnalyzer::compact() {
+  // Live marks keep their order but are packed to the front; the new
+  // position space is at least twice the live set so that compaction is
+  // amortized over as many accesses as there are live keys.
+  std::vector<std::pair<uint64_t, LastAccess *>> live;
+  live.reserve(lastAccess_.size());
+  for (auto &[keyHash, last] : lastAccess_) {
+    live.emplace_back(last.pos, &last);
+  }
+  std::sort(std::begin(live), std::end(live),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  const uint64_t numPositions =
+      std::max<uint64_t>(kMinPositions, 2 * live.size());
+  std::vector<uint64_t> objects(numPositions);
+  std::vector<uint64_t> bytes(numPositions);
+  for (uint64_t pos = 0; pos < live.size(); ++pos) {
+    live[pos].second->pos = pos;
+    objects[pos] = 1;
+    bytes[pos] = live[pos].second->size;
+  }
+  objectMarks_.reset(objects);
+  byteMarks_.reset(bytes);
+  nextPos_ = live.size();
+}
+
+void ReuseDistanceAnalyzer::finish(const std::string &outputFile,
+                                   std::ostream &os) {
+  if (!pending_.empty()) {
+    submit();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+
+  std::ofstream out(outputFile, std::ios::out | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("Failed to open file: " + outputFile);
+  }
+  // Cold (first) accesses are reported as a row with unit "cold".
+  out << "op,maxSize,unit,lowerBound,upperBound,count" << std::endl;
+  for (uint32_t op = 0; op < kNumOps; ++op) {
+    Histogram objects;
+    Histogram bytes;
+    uint64_t numCold = 0;
+    for (uint32_t sizeClass = 0; sizeClass < kNumSizeClasses; ++sizeClass) {
+      const auto &h = histograms_[op][sizeClass];
+      const uint32_t maxSize = kSizeClassBounds[sizeClass];
+      out << fmt::format("{},{},cold,,,{}", kOpNames[op], maxSize, h.numCold)
+          << std::endl;
+      h.objects.forEachBucket([&](uint64_t lo, uint64_t hi, uint64_t count) {
+        out << fmt::format("{},{},objects,{},{},{}", kOpNames[op], maxSize, lo,
+                           hi, count)
+            << std::endl;
+      });
+      h.bytes.forEachBucket([&](uint64_t lo, uint64_t hi, uint64_t count) {
+        out << fmt::format("{},{},bytes,{},{},{}", kOpNames[op], maxSize, lo,
+                           hi, count)
+            << std::endl;
+      });
+      objects.merge(h.objects);
+      bytes.merge(h.bytes);
+      numCold += h.numCold;
+    }
+
+    if (objects.count() + numCold == 0) {
+      continue;
+    }
+    os << fmt::format("Reuse distance ({}): {} reuses, {} cold; objects "
+                      "p50/p90/p99 {}/{}/{}, bytes p50/p90/p99 {}/{}/{}",
+                      kOpNames[op], objects.count(), numCold,
+                      objects.percentile(50), objects.percentile(90),
+                      objects.percentile(99), bytes.percentile(50),
+                      bytes.percentile(90), bytes.percentile(99))
+       << std::endl;
+  }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Histogram.h"
+#include "MemoryResource.h"
+#include "TraceReader.h"
+#include "include/robin_hood.h"
+
+// Binary indexed tree over positions 0..size-1 with prefix sums in
+// O(log size). Deltas may be negative; uint64_t arithmetic wraps.
+class FenwickTree {
+public:
+  void reset(const std::vector<uint64_t> &values);
+  void add(uint64_t pos, uint64_t delta);
+  // Sum of positions [0, pos).
+  uint64_t prefix(uint64_t pos) const;
+  uint64_t size() const { return tree_.size() - 1; }
+
+private:
+  std::vector<uint64_t> tree_{0};
+};
+
+// Exact stack (reuse) distance of every request: the number of distinct
+// objects, and of distinct bytes, accessed since the previous access to the
+// same key. Each live key has a mark at the position of its last access in
+// two Fenwick trees (count and size), so a distance is a range sum. The
+// position space is renumbered when it fills up, keeping memory
+// proportional to the number of live keys.
+//
+// Requests are handed over in batches to a thread of its own, so the
+// analysis runs alongside the replay.
+class ReuseDistanceAnalyzer {
+public:
+  ReuseDistanceAnalyzer();
+  ~ReuseDistanceAnalyzer();
+
+  void access(const TraceEntry &e);
+
+  // Waits for the analysis to finish, writes the histograms as CSV to
+  // outputFile and prints a summary to os.
+  void finish(const std::string &outputFile, std::ostream &os);
+
+  // Footprint of the analysis state as of the last analyzed batch, plus
+  // the batches in flight.
+  void appendMemoryUsage(std::vector<MemoryUsage> &usage);
+
+private:
+  static constexpr size_t kBatchSize = 1 << 16;
+  static constexpr size_t kMaxQueuedBatches = 8;
+  static constexpr uint64_t kMinPositions = 1 << 20;
+
+  static constexpr uint32_t kNumOps = 3;
+  static constexpr std::array<uint32_t, 5> kSizeClassBounds = {
+      64, 256, 1024, 4096, UINT32_MAX};
+  static constexpr uint32_t kNumSizeClasses = kSizeClassBounds.size();
+
+  struct Access {
+    uint64_t keyHash;
+    uint32_t size;
+    Op op;
+  };
+
+  struct LastAccess {
+    uint64_t pos;
+    uint32_t size;
+  };
+
+  struct Histograms {
+    Histogram objects;
+    Histogram bytes;
+    uint64_t numCold{0};
+  };
+
+  // Owned by the analysis thread.
+  robin_hood::unordered_map<uint64_t, LastAccess> lastAccess_;
+  FenwickTree objectMarks_;
+  FenwickTree byteMarks_;
+  uint64_t nextPos_{0};
+  std::array<std::array<Histograms, kNumSizeClasses>, kNumOps> histograms_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::vector<Access>> queue_;
+  std::vector<std::vector<Access>> freeBatches_;
+  bool stop_{false};
+  MemoryUsage stateUsage_{.table = "analytics.reuse-distance"};
+
+  // Owned by the submitting thread.
+  std::vector<Access> pending_;
+
+  static uint32_t sizeClassOf(uint32_t size);
+  void submit();
+  void run();
+  void analyze(const Access &access);
+  void compact();
+};
@@ -0,0 +1,234 @@
+#include "ShardedSim.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "include/fmt/core.h"
+
+ShardedSimulator::ShardedSimulator(uint32_t numShards, bool serial,
+                                   const Factory &factory)
+    : threaded_(numShards > 1 && !serial) {
+  assert(numShards > 0);
+  for (uint32_t shardId = 0; shardId < numShards; ++shardId) {
+    auto shard = std::make_unique<Shard>();
+    shard->sim = factory(shardId);
+    shards_.push_back(std::move(shard));
+  }
+  if (threaded_) {
+    for (auto &shard : shards_) {
+      shard->thread = std::thread([this, s = shard.get()] { run(*s); });
+    }
+  }
+  if (numShards > 1) {
+    std::cout << fmt::format("Sharded server model: {} shards ({})", numShards,
+                             threaded_ ? "one thread per shard" : "serial")
+              << std::endl;
+  }
+}
+
+ShardedSimulator::~ShardedSimulator() {
+  for (auto &shard : shards_) {
+    if (shard->thread.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->stop = true;
+      }
+      shard->cv.notify_all();
+      shard->thread.join();
+    }
+  }
+}
+
+uint32_t ShardedSimulator::shardOf(const std::string &key) const {
+  // Re-mix so shard selection is independent of the per-shard hash tables.
+  uint64_t h = std::hash<std::string>{}(key) * 0x9E3779B97F4A7C15ull;
+  return static_cast<uint32_t>((h >> 32) % shards_.size());
+}
+
+void ShardedSimulator::process(const TraceEntry &e, uint64_t nowNs) {
+  auto &shard = *shards_[shards_.size() == 1 ? 0 : shardOf(e.key)];
+  if (!threaded_) {
+    shard.sim->setTime(nowNs);
+    shard.sim->process(e);
+    return;
+  }
+
+  auto &batch = shard.pending;
+  if (batch.numRequests == batch.requests.size()) {
+    batch.requests.emplace_back();
+  }
+  auto &request = batch.requests[batch.numRequests++];
+  request.entry = e;
+  request.nowNs = nowNs;
+  if (batch.numRequests == kBatchSize) {
+    submit(shard, std::exchange(shard.pending, takeFreeBatch(shard)));
+  }
+}
+
+ShardedSimulator::Batch ShardedSimulator::takeFreeBatch(Shard &shard) {
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (shard.freeBatches.empty()) {
+    Batch batch;
+    batch.requests.reserve(kBatchSize);
+    return batch;
+  }
+  Batch batch = std::move(shard.freeBatches.back());
+  shard.freeBatches.pop_back();
+  return batch;
+}
+
+void ShardedSimulator::submit(Shard &shard, Batch &&batch) {
+  {
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.cv.wait(lock,
+                  [&] { return shard.queue.size() < kMaxQueuedBatches; });
+    shard.queue.push_back(std::move(batch));
+  }
+  shard.cv.notify_all();
+}
+
+void ShardedSimulator::run(Shard &shard) {
+  while (true) {
+    Batch batch;
+    {
+      std::unique_lock<std::mutex> lock(shard.mutex);
+      shard.cv.wait(lock, [&] { return !shard.queue.empty() || shard.stop; });
+      if (shard.queue.empty()) {
+        return;
+      }
+      batch = std::move(shard.queue.front());
+      shard.queue.pop_front();
+    }
+    shard.cv.notify_all();
+
+    for (size_t i = 0; i < batch.numRequests; ++i) {
+      const auto &request = batch.requests[i];
+      shard.sim->setTime(request.nowNs);
+      shard.sim->process(request.entry);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (batch.isMarker) {
+        const Stat &cur = shard.sim->getStat();
+        shard.delta = cur - shard.lastSnapshot;
+        shard.lastSnapshot = cur;
+        shard.numMarkersDone++;
+      }
+      batch.numRequests = 0;
+      batch.isMarker = false;
+      shard.freeBatches.push_back(std::move(batch));
+    }
+    shard.cv.notify_all();
+  }
+}
+
+const Stat &ShardedSimulator::sync() {
+  if (!threaded_) {
+    merged_ = Stat();
+    for (auto &shard : shards_) {
+      merged_ = merged_ + shard->sim->getStat();
+    }
+    return merged_;
+  }
+
+  // The pending batch doubles as the marker, so it is flushed as well.
+  numMarkersSent_++;
+  for (auto &shard : shards_) {
+    shard->pending.isMarker = true;
+    submit(*shard, std::exchange(shard->pending, takeFreeBatch(*shard)));
+  }
+  for (auto &shard : shards_) {
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    shard->cv.wait(lock,
+                   [&] { return shard->numMarkersDone == numMarkersSent_; });
+    merged_ = merged_ + shard->delta;
+  }
+  return merged_;
+}
+
+void ShardedSimulator::finish(std::ostream &os) {
+  sync();
+  for (uint32_t shardId = 0; shardId < shards_.size(); ++shardId) {
+    shards_[shardId]->sim->finish(
+        os, shards_.size() > 1 ? fmt::format("Shard {}:", shardId) : "");
+  }
+}
+
+void ShardedSimulator::reportHotKeys(std::ostream &os, uint32_t k) {
+  using Sketch = SpaceSaving Simulator::HotKeys::*;
+  const std::pair<const char *, Sketch> sketches[] = {
+      {"accesses", &Simulator::HotKeys::byAccesses},
+      {"bytes", &Simulator::HotKeys::byBytes},
+      {"overwritten hits", &Simulator::HotKeys::byOverwrittenHits}};
+
+  for (const auto &[name, sketch] : sketches) {
+    std::vector<SpaceSaving::Counter> counters;
+    uint64_t total = 0;
+    for (auto &shard : shards_) {
+      auto *hotKeys = shard->sim->getHotKeys();
+      assert(hotKeys);
+      auto &shardSketch = hotKeys->*sketch;
+      auto top = shardSketch.top(k);
+      counters.insert(std::end(counters), std::begin(top), std::end(top));
+      total += shardSketch.total();
+      shardSketch.reset();
+    }
+    std::sort(std::begin(counters), std::end(counters),
+              [](const auto &a, const auto &b) { return a.count > b.count; });
+    counters.resize(std::min<size_t>(counters.size(), k));
+
+    os << fmt::format("Hot keys by {} (total {}):", name, total);
+    for (const auto &counter : counters) {
+      os << fmt::format(" {}={}", counter.key, counter.count);
+      if (counter.error > 0) {
+        os << fmt::format("(+-{})", counter.error);
+      }
+    }
+    os << std::endl;
+  }
+}
+
+TierUsage ShardedSimulator::getTierUsage() const {
+  TierUsage usage;
+  for (const auto &shard : shards_) {
+    usage += shard->sim->getTierUsage();
+  }
+  return usage;
+}
+
+void ShardedSimulator::appendMemoryUsage(std::vector<MemoryUsage> &usage) {
+  std::vector<MemoryUsage> merged;
+  MemoryUsage batches{.table = "trace.batches"};
+  auto addBatch = [&batches](const Batch &batch) {
+    batches.reservedBytes += batch.requests.capacity() * sizeof(Request);
+    batches.usedBytes += batch.numRequests * sizeof(Request);
+    batches.numEntries += batch.numRequests;
+  };
+
+  for (auto &shard : shards_) {
+    std::vector<MemoryUsage> shardUsage;
+    shard->sim->appendMemoryUsage(shardUsage);
+    if (merged.empty()) {
+      merged = std::move(shardUsage);
+    } else {
+      assert(shardUsage.size() == merged.size());
+      for (size_t i = 0; i < shardUsage.size(); ++i) {
+        merged[i].reservedBytes += shardUsage[i].reservedBytes;
+        merged[i].usedBytes += shardUsage[i].usedBytes;
+        merged[i].numEntries += shardUsage[i].numEntries;
+      }
+    }
+
+    addBatch(shard->pending);
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    for (const auto &batch : shard->queue) {
+      addBatch(batch);
+    }
+    for (const auto &batch : shard->freeBatches) {
+      addBatch(batch);
+    }
+  }
+  usage.insert(std::end(usage), std::begin(merged), std::end(merged));
+  usage.push_back(batches);
+}
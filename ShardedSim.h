@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "Sim.h"
+#include "TraceReader.h"
+#include "stat.h"
+
+// Models a cache server that partitions its key space into numShards
+// independent caches, each owning 1/numShards of the DRAM and flash
+// capacity (the factory decides the split). Every shard replays exactly
+// the subsequence of requests whose keys hash to it, in trace order, so
+// the result is that of a sharded server - it is not an approximation of
+// one big cache - and it does not depend on thread scheduling.
+//
+// With one shard, or in serial mode, requests are replayed inline on the
+// caller's thread. Otherwise each shard runs on its own thread, fed in
+// batches by the dispatching thread; sync() is a barrier that merges the
+// per-shard Stat deltas at a stats interval.
+class ShardedSimulator {
+public:
+  using Factory = std::function<std::unique_ptr<Simulator>(uint32_t shardId)>;
+
+  ShardedSimulator(uint32_t numShards, bool serial, const Factory &factory);
+  ~ShardedSimulator();
+
+  void process(const TraceEntry &e, uint64_t nowNs);
+
+  // Waits until every shard has replayed all dispatched requests and
+  // returns the merged statistics.
+  const Stat &sync();
+
+  // Prints the k hottest keys of the interval across all shards and resets
+  // the sketches. Keys are partitioned by shard, so the per-shard lists
+  // merge without double counting. Call right after sync().
+  void reportHotKeys(std::ostream &os, uint32_t k);
+
+  // Estimated footprint per component summed over the shards, plus the
+  // request batches in flight. Call right after sync().
+  void appendMemoryUsage(std::vector<MemoryUsage> &usage);
+
+  // Tier usage summed over the shards. Call right after sync().
+  TierUsage getTierUsage() const;
+
+  // Drains and stops the shards and prints their final reports.
+  void finish(std::ostream &os);
+
+  uint32_t getNumShards() const { return shards_.size(); }
+  Simulator &getShard(uint32_t shardId) { return *shards_[shardId]->sim; }
+
+private:
+  static constexpr size_t kBatchSize = 4096;
+  static constexpr size_t kMaxQueuedBatches = 16;
+
+  struct Request {
+    TraceEntry entry;
+    uint64_t nowNs;
+  };
+
+  // Batches are recycled so that request keys keep their string capacity.
+  struct Batch {
+    std::vector<Request> requests;
+    size_t numRequests{0};
+    bool isMarker{false};
+  };
+
+  struct Shard {
+    std::unique_ptr<Simulator> sim;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Batch> queue;
+    std::vector<Batch> freeBatches;
+    bool stop{false};
+
+    uint64_t numMarkersDone{0};
+    Stat lastSnapshot;
+    Stat delta;
+
+    // Owned by the dispatching thread.
+    Batch pending;
+  };
+
+  const bool threaded_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  uint64_t numMarkersSent_{0};
+  Stat merged_;
+
+  uint32_t shardOf(const std::string &key) const;
+  void submit(Shard &shard, Batch &&batch);
+  Batch takeFreeBatch(Shard &shard);
+  void run(Shard &shard);
+};
@@ -1,31 +1,205 @@
 #pragma once
 
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "BlockCache.h"
+#include "Clock.h"
 #include "DRAMCache.h"
+#include "MemoryResource.h"
+#include "Profile.h"
+#include "SpaceSaving.h"
+#include "SsdQueueSim.h"
+#include "TraceReader.h"
 #include "fifo.h"
+#include "include/fmt/core.h"
+
+// How FIFO hits are promoted to DRAM. Inclusive keeps the flash copy, so
+// a promoted object is dropped from DRAM on eviction. Exclusive moves it:
+// the flash copy is invalidated, and the object is rewritten to flash when
+// DRAM evicts it.
+enum class Hierarchy { kInclusive, kExclusive };
+
+// Capacity and cached object bytes of each tier, at one point in time.
+struct TierUsage {
+  uint64_t dramCapacity{0};
+  uint64_t dramBytes{0};
+  uint64_t fifoCapacity{0};
+  uint64_t fifoBytes{0};
+  // DRAM objects that also have a live FIFO copy.
+  uint64_t duplicateBytes{0};
+
+  TierUsage &operator+=(const TierUsage &other) {
+    dramCapacity += other.dramCapacity;
+    dramBytes += other.dramBytes;
+    fifoCapacity += other.fifoCapacity;
+    fifoBytes += other.fifoBytes;
+    duplicateBytes += other.duplicateBytes;
+    return *this;
+  }
+};
+
+inline void printTierUsage(std::ostream &os, const TierUsage &usage) {
+  constexpr double MB = 1024 * 1024;
+  auto percent = [](uint64_t part, uint64_t whole) {
+    return whole > 0 ? 100.0 * part / whole : 0.0;
+  };
+  os << fmt::format("Tiers: DRAM {:.2f} / {:.2f} MB ({:.1f}%, {:.1f}% also "
+                    "in FIFO), FIFO {:.2f} / {:.2f} MB ({:.1f}%), {:.2f} MB "
+                    "of distinct objects",
+                    usage.dramBytes / MB, usage.dramCapacity / MB,
+                    percent(usage.dramBytes, usage.dramCapacity),
+                    percent(usage.duplicateBytes, usage.dramBytes),
+                    usage.fifoBytes / MB, usage.fifoCapacity / MB,
+                    percent(usage.fifoBytes, usage.fifoCapacity),
+                    (usage.dramBytes + usage.fifoBytes - usage.duplicateBytes) /
+                        MB)
+     << std::endl;
+}
 
 class Simulator {
 public:
   Simulator(uint64_t ssdSize, const std::string &overwrittenLog,
-            const std::string &overwrittenAccLog, uint64_t dramSize)
-      : fifo_(stat_, ssdSize, overwrittenLog, overwrittenAccLog),
-        dramCache_(stat_, dramSize) {}
+            const std::string &overwrittenAccLog, uint64_t dramSize,
+            uint32_t segmentSize = Fifo::kDefaultSegmentSize,
+            uint32_t pageSize = Fifo::kDefaultPageSize,
+            bool hugePageArena = false)
+      : memory_(hugePageArena ? std::make_unique<Memory>() : nullptr),
+        fifo_(Fifo::create(
+            stat_, clock_, ssdSize, overwrittenLog, overwrittenAccLog,
+            segmentSize, pageSize,
+            memory_ ? memory_->fifoHistories.resource()
+                    : std::pmr::new_delete_resource())),
+        dramCache_(stat_, clock_, dramSize,
+                   memory_ ? memory_->dramLru.resource()
+                           : std::pmr::new_delete_resource()) {}
+
+  // Models flash queueing underneath the FIFO: hits become page reads and
+  // sealed segments become background page programs on the SSD model.
+  void enableSsdQueueSim(const SsdQueueSim::Config &config) {
+    ssdSim_ = std::make_unique<SsdQueueSim>(config);
+    fifo_->setSegmentWriteHandler([this](uint32_t segId) {
+      const uint32_t numPages = fifo_->getNumPagesPerSegment();
+      ssdSim_->submitSegmentWrite(segId * numPages, numPages);
+    });
+    fifo_->setFalseReadHandler(
+        [this](uint32_t pageId) { ssdSim_->submitRead(pageId); });
+  }
+
+  // Routes objects larger than threshold to a region-based flash engine
+  // instead of the FIFO. Both share the DRAM tier in front of them.
+  void enableLargeObjectCache(uint64_t capacity, uint32_t regionSize,
+                              BlockCache::EvictionPolicy policy,
+                              uint32_t threshold) {
+    largeCache_ = std::make_unique<BlockCache>(stat_, clock_, capacity,
+                                               regionSize, policy);
+    largeObjectThreshold_ = threshold;
+  }
+
+  // With chargeDram the modelled index shrinks the DRAM cache.
+  void enableTagIndex(const TagIndexConfig &config) {
+    fifo_->enableTagIndex(config);
+    if (config.chargeDram) {
+      dramCache_.reserveCapacity(fifo_->getTagIndex()->tableBytes());
+    }
+  }
+
+  void enableOutOfCoreAnalytics(const std::filesystem::path &dir,
+                                uint64_t hotBytes) {
+    fifo_->enableOutOfCoreAnalytics(dir, hotBytes);
+  }
+
+  void enableWriteStreams(const FifoStreamConfig &config) {
+    fifo_->enableWriteStreams(config);
+  }
+
+  void addFlashDevice(const FlashDeviceConfig &config) {
+    fifo_->addFlashDevice(config);
+  }
+
+  void enableIoEmulation(const IoEmulationConfig &config) {
+    fifo_->enableIoEmulation(config);
+  }
 
-  bool lookup(const std::string &key) {
+  void enableProactiveExpiry() {
+    proactiveExpiry_ = true;
+    dramCache_.enableProactiveExpiry();
+    fifo_->enableProactiveExpiry();
+  }
+
+  // Heavy hitters among looked-up keys: by accesses, by bytes, and by FIFO
+  // overwritten hits (misses on keys the FIFO had dropped on rotation).
+  struct HotKeys {
+    explicit HotKeys(uint32_t capacity)
+        : byAccesses(capacity), byBytes(capacity),
+          byOverwrittenHits(capacity) {}
+
+    SpaceSaving byAccesses;
+    SpaceSaving byBytes;
+    SpaceSaving byOverwrittenHits;
+  };
+
+  void enableHotKeyTracking(uint32_t capacity) {
+    hotKeys_ = std::make_unique<HotKeys>(capacity);
+  }
+
+  HotKeys *getHotKeys() { return hotKeys_.get(); }
+
+  // Advances the simulated clock to the arrival time of the next request.
+  void setTime(uint64_t nowNs) {
+    const uint32_t prevSec = clock_.nowSec();
+    clock_.nowNs = std::max(clock_.nowNs, nowNs);
+    if (ssdSim_) {
+      ssdSim_->advanceTo(clock_.nowNs);
+    }
+    if (proactiveExpiry_ && clock_.nowSec() != prevSec) {
+      dramCache_.expire();
+      fifo_->expire();
+    }
+  }
+
+  bool lookup(const std::string &key, uint32_t size) {
     stat_.numAccesses++;
+    if (hotKeys_) {
+      hotKeys_->byAccesses.update(key);
+      hotKeys_->byBytes.update(key, size);
+    }
 
     if (auto item = dramCache_.lookup(key)) {
       stat_.numHits++;
       return true;
     }
 
-    if (auto item = fifo_.lookup(key)) {
-      stat_.numHits++;
-      auto victimsFromDram = dramCache_.insert(key, item.value().size, true);
+    if (isLarge(size)) {
+      if (auto item = largeCache_->lookup(key)) {
+        stat_.numHits++;
+        dramCache_.insert(key, item.value().size, true,
+                          item.value().expiryTime, FlashSink{this});
+        return true;
+      }
+      return false;
+    }
 
-      for (const auto &victim : victimsFromDram) {
-        if (!victim.isInFifo) {
-          fifo_.insert(victim);
+    const uint64_t prevOverwrittenHits = stat_.numFifoOverWrittenHits;
+    auto item = fifo_->lookup(key);
+    if (hotKeys_ && stat_.numFifoOverWrittenHits != prevOverwrittenHits) {
+      hotKeys_->byOverwrittenHits.update(key);
+    }
+    if (item) {
+      stat_.numHits++;
+      if (ssdSim_) {
+        ssdSim_->submitRead(item.value().pageId);
+      }
+      // numAccesses counts the FIFO hits of this copy, this one included.
+      if (item.value().numAccesses >= promoteAfterHits_) {
+        const bool exclusive = hierarchy_ == Hierarchy::kExclusive;
+        if (exclusive) {
+          fifo_->remove(key);
         }
+        dramCache_.insert(key, item.value().size, !exclusive,
+                          item.value().expiryTime, FlashSink{this});
       }
       return true;
     }
@@ -33,27 +207,218 @@ public:
     return false;
   }
 
-  void insert(const std::string &key, uint32_t size) {
-    auto victimsFromDram = dramCache_.insert(key, size, false);
+  void insert(const std::string &key, uint32_t size, uint32_t ttl = 0) {
+    dramCache_.insert(key, size, false, clock_.expiryTimeFor(ttl),
+                      FlashSink{this});
+  }
 
-    for (const auto &victim : victimsFromDram) {
-      if (!victim.isInFifo) {
-        fifo_.insert(victim);
-      }
+  // SET/REPLACE: the DRAM copy is updated in place and any flash copy is
+  // stale from now on. With write-through the new value also goes straight
+  // to flash, so it is not rewritten when it is later evicted from DRAM.
+  void set(const std::string &key, uint32_t size, uint32_t ttl = 0) {
+    stat_.numSets++;
+
+    bool invalidated = fifo_->remove(key);
+    if (largeCache_) {
+      invalidated |= largeCache_->remove(key);
+    }
+    if (invalidated) {
+      stat_.numFifoInvalidations++;
     }
+
+    const uint32_t expiryTime = clock_.expiryTimeFor(ttl);
+    if (writeThrough_) {
+      stat_.numUpdateFlashWrites++;
+      stat_.updateFlashWriteBytes += size + Fifo::Item::kMetadataSize;
+      writeToFlash({.key = key,
+                    .size = size,
+                    .numAccesses = 0,
+                    .isInFifo = false,
+                    .expiryTime = expiryTime});
+    }
+
+    dramCache_.update(key, size, writeThrough_, expiryTime, FlashSink{this});
+  }
+
+  void setWriteThrough(bool writeThrough) { writeThrough_ = writeThrough; }
+
+  // FIFO hits are served from flash until the promoteAfterHits-th one.
+  void setHierarchy(Hierarchy hierarchy, uint32_t promoteAfterHits) {
+    hierarchy_ = hierarchy;
+    promoteAfterHits_ = promoteAfterHits;
+  }
+
+  // Walks the DRAM cache to find the duplicates.
+  TierUsage getTierUsage() const {
+    TierUsage usage{.dramCapacity = dramCache_.getCapacity(),
+                    .dramBytes = dramCache_.getUsedBytes(),
+                    .fifoCapacity = fifo_->getCapacity(),
+                    .fifoBytes = fifo_->getLiveBytes()};
+    dramCache_.forEachItem([&](const DRAMCache::Item &item) {
+      if (fifo_->contains(item.key)) {
+        usage.duplicateBytes += item.size;
+      }
+    });
+    return usage;
   }
 
   void remove(const std::string &key) {
     stat_.numRemoved++;
 
     dramCache_.remove(key);
-    fifo_.remove(key);
+    fifo_->remove(key);
+    if (largeCache_) {
+      largeCache_->remove(key);
+    }
+  }
+
+  bool hasLargeObjectCache() const { return largeCache_ != nullptr; }
+
+  // Replays one request of the trace.
+  void process(const TraceEntry &e) {
+    PROFILE_COUNT(kRequests, 1);
+    switch (e.op) {
+    case Op::kDelete:
+      remove(e.key);
+      break;
+    case Op::kSet:
+      set(e.key, e.size, e.ttl);
+      break;
+    default:
+      if (!lookup(e.key, e.size)) {
+        insert(e.key, e.size, e.ttl);
+      }
+      break;
+    }
   }
 
   const Stat& getStat() const { return stat_; }
 
+  // Estimated footprint of every component, in an order that only depends
+  // on the configuration. Arena backed tables report their pool instead of
+  // the estimate.
+  void appendMemoryUsage(std::vector<MemoryUsage> &usage) const {
+    const size_t first = usage.size();
+    dramCache_.appendMemoryUsage(usage);
+    fifo_->appendMemoryUsage(usage);
+    if (largeCache_) {
+      largeCache_->appendMemoryUsage(usage);
+    }
+    if (ssdSim_) {
+      ssdSim_->addMemoryUsage(
+          usage.emplace_back(MemoryUsage{.table = "ssd-sim"}));
+    }
+    if (hotKeys_) {
+      auto &sketches =
+          usage.emplace_back(MemoryUsage{.table = "analytics.hot-keys"});
+      hotKeys_->byAccesses.addMemoryUsage(sketches);
+      hotKeys_->byBytes.addMemoryUsage(sketches);
+      hotKeys_->byOverwrittenHits.addMemoryUsage(sketches);
+    }
+    if (memory_) {
+      for (size_t i = first; i < usage.size(); ++i) {
+        const TablePool *pool = usage[i].table == "dram.lru" ? &memory_->dramLru
+                                : usage[i].table == "fifo.history"
+                                    ? &memory_->fifoHistories
+                                    : nullptr;
+        if (pool) {
+          usage[i].reservedBytes = pool->reservedBytes();
+          usage[i].usedBytes = pool->usedBytes();
+        }
+      }
+      usage.push_back({.table = "arena",
+                       .reservedBytes = memory_->arena.reservedBytes(),
+                       .usedBytes = memory_->arena.usedBytes()});
+    }
+  }
+
+  // label names the shard in the report of a sharded run.
+  void finish(std::ostream &os, const std::string &label = "") {
+    const TagIndexModel *tagIndex = fifo_->getTagIndex();
+    IoEmulator *ioEmulator = fifo_->getIoEmulator();
+    const bool hasStreams = fifo_->getNumStreams() > 1;
+    const auto &devices = fifo_->getFlashDevices();
+    if (!ssdSim_ && !tagIndex && !ioEmulator && !hasStreams &&
+        devices.empty()) {
+      return;
+    }
+    if (!label.empty()) {
+      os << label << std::endl;
+    }
+    if (ssdSim_) {
+      ssdSim_->drain();
+      ssdSim_->report(os);
+    }
+    if (tagIndex) {
+      tagIndex->report(os, fifo_->getNumItems());
+    }
+    if (hasStreams) {
+      fifo_->reportStreams(os);
+    }
+    for (const auto &device : devices) {
+      device->report(os);
+    }
+    if (ioEmulator) {
+      ioEmulator->drain();
+      ioEmulator->report(os);
+    }
+  }
+
 private:
+  // DRAM LRU nodes and FIFO per-key histories, pooled per table on a huge
+  // page arena. Declared before the tables that allocate from it.
+  struct Memory {
+    HugePageArena arena;
+    TablePool dramLru{&arena};
+    TablePool fifoHistories{&arena};
+  };
+
+  std::unique_ptr<Memory> memory_;
   Stat stat_;
-  Fifo fifo_;
+  Clock clock_;
+  std::unique_ptr<Fifo> fifo_;
   DRAMCache dramCache_;
+  std::unique_ptr<SsdQueueSim> ssdSim_;
+  std::unique_ptr<BlockCache> largeCache_;
+  std::unique_ptr<HotKeys> hotKeys_;
+  uint32_t largeObjectThreshold_{0};
+  bool proactiveExpiry_{false};
+  bool writeThrough_{false};
+  Hierarchy hierarchy_{Hierarchy::kInclusive};
+  uint32_t promoteAfterHits_{1};
+
+  bool isLarge(uint32_t size) const {
+    return largeCache_ && size > largeObjectThreshold_;
+  }
+
+  void writeToFlash(const DRAMCache::Item &item) {
+    if (isLarge(item.size)) {
+      largeCache_->insert(item);
+    } else {
+      fifo_->insert(item);
+    }
+  }
+
+  // isInFifo marks items that already have a copy on flash, in whichever
+  // engine their size routes them to.
+  void evictToFlash(const DRAMCache::Item &victim) {
+    if (victim.isInFifo) {
+      return;
+    }
+    // Items that expired in DRAM are dropped instead of written to flash.
+    if (clock_.isExpired(victim.expiryTime)) {
+      stat_.numDramExpired++;
+      stat_.dramExpiredBytes += victim.size;
+      return;
+    }
+    writeToFlash(victim);
+  }
+
+  // DRAM victim sink that forwards to evictToFlash().
+  struct FlashSink {
+    Simulator *sim;
+    void operator()(const DRAMCache::Item &victim) const {
+      sim->evictToFlash(victim);
+    }
+  };
 };
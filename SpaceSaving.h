@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MemoryResource.h"
+#include "include/robin_hood.h"
+
+// Space-Saving heavy-hitter sketch (Metwally et al.) with capacity
+// counters. A tracked key's count is incremented in place; an untracked
+// key replaces the key with the smallest count and inherits that count as
+// its overestimation error. Any key whose true weight exceeds
+// total / capacity is guaranteed to be tracked. Counters form a min-heap so
+// an update costs O(log capacity); memory is fixed.
+class SpaceSaving {
+public:
+  struct Counter {
+    std::string key;
+    uint64_t count;
+    // count - error is a lower bound of the true weight.
+    uint64_t error;
+  };
+
+  explicit SpaceSaving(uint32_t capacity) : capacity_(capacity) {
+    heap_.reserve(capacity);
+    index_.reserve(capacity);
+  }
+
+  void update(const std::string &key, uint64_t weight = 1) {
+    total_ += weight;
+    if (auto it = index_.find(key); it != std::end(index_)) {
+      heap_[it->second].count += weight;
+      siftDown(it->second);
+      return;
+    }
+    if (heap_.size() < capacity_) {
+      heap_.push_back({key, weight, 0});
+      index_[key] = heap_.size() - 1;
+      siftUp(heap_.size() - 1);
+      return;
+    }
+    auto &min = heap_.front();
+    index_.erase(min.key);
+    min.error = min.count;
+    min.count += weight;
+    min.key = key;
+    index_[key] = 0;
+    siftDown(0);
+  }
+
+  // The k largest counters, largest first.
+  std::vector<Counter> top(uint32_t k) const {
+    std::vector<Counter> counters = heap_;
+    auto byCount = [](const Counter &a, const Counter &b) {
+      return a.count > b.count;
+    };
+    k = std::min<uint32_t>(k, counters.size());
+    std::partial_sort(std::begin(counters), std::begin(counters) + k,
+                      std::end(counters), byCount);
+    counters.resize(k);
+    return counters;
+  }
+
+  uint64_t total() const { return total_; }
+
+  void addMemoryUsage(MemoryUsage &usage) const {
+    usage.reservedBytes += heap_.capacity() * sizeof(Counter);
+    usage.usedBytes += heap_.size() * sizeof(Counter);
+    addTableUsage(usage, index_);
+  }
+
+  void reset() {
+    heap_.clear();
+    index_.clear();
+    total_ = 0;
+  }
+
+private:
+  const uint32_t capacity_;
+  std::vector<Counter> heap_;
+  robin_hood::unordered_map<std::string, size_t> index_;
+  uint64_t total_{0};
+
+  void swapCounters(size_t a, size_t b) {
+    std::swap(heap_[a], heap_[b]);
+    index_[heap_[a].key] = a;
+    index_[heap_[b].key] = b;
+  }
+
+  void siftUp(size_t i) {
+    while (i > 0) {
+      size_t parent = (i - 1) / 2;
+      if (heap_[parent].count <= heap_[i].count) {
+        break;
+      }
+      swapCounters(i, parent);
+      i = parent;
+    }
+  }
+
+  void siftDown(size_t i) {
+    while (true) {
+      size_t smallest = i;
+      for (size_t child = 2 * i + 1; child <= 2 * i + 2; ++child) {
+        if (child < heap_.size() &&
+            heap_[child].count < heap_[smallest].count) {
+          smallest = child;
+        }
+      }
+      if (smallest == i) {
+        return;
+      }
+      swapCounters(i, smallest);
+      i = smallest;
+    }
+  }
+};
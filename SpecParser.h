@@ -0,0 +1,32 @@
+#pragma once
+
+#include <charconv>
+#include <stdexcept>
+#include <string_view>
+
+#include "include/fmt/core.h"
+
+// Helpers for the comma-separated key=value specs of the command line,
+// e.g. "tag-bits=12,slots=16".
+
+// Splits s at the first sep; s keeps the remainder.
+inline std::string_view nextToken(std::string_view &s, char sep) {
+  const auto pos = s.find(sep);
+  const auto token = s.substr(0, pos);
+  s = pos == std::string_view::npos ? std::string_view() : s.substr(pos + 1);
+  return token;
+}
+
+// Parses all of s as the value of key. spec names the spec in the error,
+// e.g. "flash index". Throws std::invalid_argument on malformed values.
+template <typename T>
+T parseSpecNumber(std::string_view spec, std::string_view key,
+                  std::string_view s) {
+  T value{};
+  auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+  if (ec != std::errc() || end != s.data() + s.size()) {
+    throw std::invalid_argument(
+        fmt::format("Bad value for {} parameter {}: {}", spec, key, s));
+  }
+  return value;
+}
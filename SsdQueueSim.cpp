@@ -0,0 +1,135 @@
+#include "SsdQueueSim.h"
+
+#include <cassert>
+
+#include "include/fmt/core.h"
+
+SsdQueueSim::SsdQueueSim(const Config &config)
+    : config_(config), channels_(config.numChannels) {
+  assert(config_.numChannels > 0);
+  events_.reserve(config_.numChannels);
+}
+
+void SsdQueueSim::advanceTo(uint64_t nowNs) {
+  while (!events_.empty() && events_.top().time <= nowNs) {
+    auto e = events_.pop();
+    now_ = e.time;
+    numEvents_++;
+    assert(e.type == kChannelDone);
+    complete(e.arg);
+  }
+  now_ = std::max(now_, nowNs);
+}
+
+void SsdQueueSim::submitRead(uint32_t pageId) {
+  uint32_t channelId = pageId % config_.numChannels;
+  channels_[channelId].readQueue.push_back({now_, 0});
+  numReads_++;
+  if (!channels_[channelId].busy) {
+    startNext(channelId);
+  }
+}
+
+void SsdQueueSim::submitSegmentWrite(uint32_t firstPageId, uint32_t numPages) {
+  uint64_t flushId = nextFlushId_++;
+  inFlightFlushes_[flushId] = {now_, numPages};
+  for (uint32_t pageId = firstPageId; pageId < firstPageId + numPages;
+       ++pageId) {
+    uint32_t channelId = pageId % config_.numChannels;
+    channels_[channelId].writeQueue.push_back({now_, flushId});
+    numPrograms_++;
+  }
+  for (uint32_t channelId = 0; channelId < config_.numChannels; ++channelId) {
+    if (!channels_[channelId].busy) {
+      startNext(channelId);
+    }
+  }
+}
+
+void SsdQueueSim::drain() {
+  while (!events_.empty()) {
+    advanceTo(events_.top().time);
+  }
+}
+
+void SsdQueueSim::startNext(uint32_t channelId) {
+  auto &channel = channels_[channelId];
+  assert(!channel.busy);
+
+  uint64_t serviceTime = 0;
+  if (!channel.readQueue.empty()) {
+    channel.inFlight = channel.readQueue.front();
+    channel.readQueue.pop_front();
+    channel.servingRead = true;
+    serviceTime = config_.readLatencyNs;
+    readQueueDelay_.record(now_ - channel.inFlight.submitTime);
+  } else if (!channel.writeQueue.empty()) {
+    channel.inFlight = channel.writeQueue.front();
+    channel.writeQueue.pop_front();
+    channel.servingRead = false;
+    serviceTime = config_.programLatencyNs;
+    writeQueueDelay_.record(now_ - channel.inFlight.submitTime);
+  } else {
+    return;
+  }
+
+  channel.busy = true;
+  channel.busyTime += serviceTime;
+  events_.push({now_ + serviceTime, kChannelDone, channelId});
+}
+
+void SsdQueueSim::complete(uint32_t channelId) {
+  auto &channel = channels_[channelId];
+  assert(channel.busy);
+  channel.busy = false;
+
+  if (channel.servingRead) {
+    readLatency_.record(now_ - channel.inFlight.submitTime);
+  } else {
+    auto it = inFlightFlushes_.find(channel.inFlight.flushId);
+    assert(it != std::end(inFlightFlushes_));
+    if (--it->second.remainingPages == 0) {
+      flushLatency_.record(now_ - it->second.submitTime);
+      inFlightFlushes_.erase(it);
+    }
+  }
+
+  startNext(channelId);
+}
+
+void SsdQueueSim::report(std::ostream &os) const {
+  uint64_t busyTime = 0;
+  for (const auto &channel : channels_) {
+    busyTime += channel.busyTime;
+  }
+  double utilization =
+      now_ ? static_cast<double>(busyTime) / (now_ * config_.numChannels) : 0.0;
+
+  os << fmt::format("SSD queue model: {} channels, {:.3f} s simulated, "
+                    "{} reads, {} page programs, {} events, "
+                    "channel utilization {:.2f}%",
+                    config_.numChannels, now_ / 1e9, numReads_, numPrograms_,
+                    numEvents_, utilization * 100.0)
+     << std::endl;
+  printHistogram(os, "read queue delay", readQueueDelay_);
+  printHistogram(os, "read latency", readLatency_);
+  printHistogram(os, "write queue delay", writeQueueDelay_);
+  printHistogram(os, "segment flush", flushLatency_);
+}
+
+// Pending operations and flushes; the histograms are fixed size.
+void SsdQueueSim::addMemoryUsage(MemoryUsage &usage) const {
+  usage.reservedBytes += events_.capacity() * sizeof(EventQueue::Event) +
+                         channels_.capacity() * sizeof(Channel);
+  usage.usedBytes += events_.size() * sizeof(EventQueue::Event) +
+                     channels_.size() * sizeof(Channel);
+  usage.numEntries += events_.size();
+  for (const auto &channel : channels_) {
+    const uint64_t numOps =
+        channel.readQueue.size() + channel.writeQueue.size();
+    usage.reservedBytes += numOps * sizeof(PendingOp);
+    usage.usedBytes += numOps * sizeof(PendingOp);
+    usage.numEntries += numOps;
+  }
+  addTableUsage(usage, inFlightFlushes_);
+}
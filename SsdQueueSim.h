@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <vector>
+
+#include "EventQueue.h"
+#include "Histogram.h"
+#include "MemoryResource.h"
+#include "include/robin_hood.h"
+
+// Discrete-event model of the flash device underneath Fifo. Pages are
+// striped over numChannels independent channels; each channel serves one
+// operation at a time from a read queue and a write queue (reads first,
+// but an in-flight program is never preempted). Foreground flash hits
+// become page reads, sealed segments become background page programs, so
+// reads queue up behind segment flushes the way they do on a real drive.
+class SsdQueueSim {
+public:
+  struct Config {
+    uint32_t numChannels{8};
+    uint64_t readLatencyNs{80'000};
+    uint64_t programLatencyNs{600'000};
+  };
+
+  explicit SsdQueueSim(const Config &config);
+
+  // Processes every event scheduled at or before nowNs. The simulated clock
+  // never moves backwards; stale timestamps are clamped to the current time.
+  void advanceTo(uint64_t nowNs);
+
+  void submitRead(uint32_t pageId);
+
+  void submitSegmentWrite(uint32_t firstPageId, uint32_t numPages);
+
+  // Runs the event loop until every queued operation has completed.
+  void drain();
+
+  void report(std::ostream &os) const;
+
+  void addMemoryUsage(MemoryUsage &usage) const;
+
+  uint64_t now() const { return now_; }
+
+private:
+  enum EventType : uint32_t { kChannelDone = 0 };
+
+  struct PendingOp {
+    uint64_t submitTime;
+    uint64_t flushId;
+  };
+
+  struct Channel {
+    bool busy{false};
+    bool servingRead{false};
+    PendingOp inFlight{0, 0};
+    uint64_t busyTime{0};
+    std::deque<PendingOp> readQueue;
+    std::deque<PendingOp> writeQueue;
+  };
+
+  struct Flush {
+    uint64_t submitTime;
+    uint32_t remainingPages;
+  };
+
+  const Config config_;
+  uint64_t now_{0};
+
+  EventQueue events_;
+  std::vector<Channel> channels_;
+
+  uint64_t nextFlushId_{0};
+  robin_hood::unordered_map<uint64_t, Flush> inFlightFlushes_;
+
+  Histogram readQueueDelay_;
+  Histogram readLatency_;
+  Histogram writeQueueDelay_;
+  Histogram flushLatency_;
+
+  uint64_t numReads_{0};
+  uint64_t numPrograms_{0};
+  uint64_t numEvents_{0};
+
+  void startNext(uint32_t channelId);
+  void complete(uint32_t channelId);
+};
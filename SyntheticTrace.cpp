@@ -0,0 +1,294 @@
+#include "SyntheticTrace.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "SpecParser.h"
+#include "Trace.h"
+#include "include/fmt/core.h"
+
+namespace {
+
+constexpr std::string_view kSpecName = "synthetic trace";
+
+uint64_t mix64(uint64_t h) {
+  h ^= h >> 30;
+  h *= 0xBF58476D1CE4E5B9ull;
+  h ^= h >> 27;
+  h *= 0x94D049BB133111EBull;
+  return h ^ (h >> 31);
+}
+
+// Uniform double in [0, 1) from the top 53 bits, identical on every
+// platform (unlike std::uniform_real_distribution).
+double toUnit(uint64_t bits) { return (bits >> 11) * 0x1.0p-53; }
+
+double helper1(double x) {
+  return std::abs(x) > 1e-8 ? std::log1p(x) / x
+                            : 1 - x * (0.5 - x * (1.0 / 3 - x * 0.25));
+}
+
+double helper2(double x) {
+  return std::abs(x) > 1e-8 ? std::expm1(x) / x
+                            : 1 + x * 0.5 * (1 + x / 3 * (1 + x * 0.25));
+}
+
+} // namespace
+
+SyntheticConfig parseSyntheticConfig(std::string_view spec) {
+  SyntheticConfig config;
+  while (!spec.empty()) {
+    auto value = nextToken(spec, ',');
+    const auto key = nextToken(value, '=');
+    if (key == "requests") {
+      config.numRequests = parseSpecNumber<uint64_t>(kSpecName, key, value);
+    } else if (key == "keys") {
+      config.numKeys = parseSpecNumber<uint64_t>(kSpecName, key, value);
+    } else if (key == "alpha") {
+      config.alpha = parseSpecNumber<double>(kSpecName, key, value);
+    } else if (key == "size") {
+      const auto kind = nextToken(value, ':');
+      if (kind == "fixed") {
+        config.sizeDistribution = SyntheticConfig::SizeDistribution::kFixed;
+        config.sizeA = parseSpecNumber<uint32_t>(kSpecName, key, value);
+      } else if (kind == "uniform") {
+        config.sizeDistribution = SyntheticConfig::SizeDistribution::kUniform;
+        config.sizeA =
+            parseSpecNumber<uint32_t>(kSpecName, key, nextToken(value, ':'));
+        config.sizeB = parseSpecNumber<uint32_t>(kSpecName, key, value);
+      } else if (kind == "lognormal") {
+        config.sizeDistribution =
+            SyntheticConfig::SizeDistribution::kLognormal;
+        config.sizeA =
+            parseSpecNumber<uint32_t>(kSpecName, key, nextToken(value, ':'));
+        config.sizeSigma = parseSpecNumber<double>(kSpecName, key, value);
+      } else {
+        throw std::invalid_argument(
+            fmt::format("Unknown size distribution: {}", kind));
+      }
+    } else if (key == "max-size") {
+      config.maxSize = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "delete") {
+      config.deleteRatio = parseSpecNumber<double>(kSpecName, key, value);
+    } else if (key == "set") {
+      config.setRatio = parseSpecNumber<double>(kSpecName, key, value);
+    } else if (key == "burst") {
+      config.burstRatio = parseSpecNumber<double>(kSpecName, key, value);
+    } else if (key == "max-burst") {
+      config.maxBurst = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "phase") {
+      config.phaseLength = parseSpecNumber<uint64_t>(kSpecName, key, value);
+    } else if (key == "rate") {
+      config.requestRate = parseSpecNumber<uint64_t>(kSpecName, key, value);
+    } else if (key == "seed") {
+      config.seed = parseSpecNumber<uint64_t>(kSpecName, key, value);
+    } else if (key == "threads") {
+      config.numThreads = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else {
+      throw std::invalid_argument(
+          fmt::format("Unknown synthetic trace parameter: {}", key));
+    }
+  }
+
+  if (config.numKeys == 0 || config.alpha < 0 ||
+      config.deleteRatio + config.setRatio > 1 || config.maxBurst < 2 ||
+      (config.sizeDistribution == SyntheticConfig::SizeDistribution::kUniform &&
+       config.sizeA > config.sizeB)) {
+    throw std::invalid_argument("Inconsistent synthetic trace parameters");
+  }
+  return config;
+}
+
+ZipfSampler::ZipfSampler(uint64_t n, double alpha) : n_(n), alpha_(alpha) {
+  hIntegralX1_ = hIntegral(1.5) - 1;
+  hIntegralN_ = hIntegral(n + 0.5);
+  s_ = 2 - hIntegralInverse(hIntegral(2.5) - h(2));
+}
+
+double ZipfSampler::h(double x) const { return std::exp(-alpha_ * std::log(x)); }
+
+double ZipfSampler::hIntegral(double x) const {
+  const double logX = std::log(x);
+  return helper2((1 - alpha_) * logX) * logX;
+}
+
+double ZipfSampler::hIntegralInverse(double x) const {
+  const double t = std::max(x * (1 - alpha_), -1.0);
+  return std::exp(helper1(t) * x);
+}
+
+SyntheticGenerator::SyntheticGenerator(const SyntheticConfig &config)
+    : config_(config), zipf_(config.numKeys, config.alpha),
+      phaseShift_(static_cast<uint64_t>(config.numKeys * 0.381966) + 1) {}
+
+uint32_t SyntheticGenerator::sizeOf(uint64_t keyId) const {
+  const uint64_t r = mix64(keyId ^ mix64(config_.seed));
+  double size = config_.sizeA;
+  switch (config_.sizeDistribution) {
+  case SyntheticConfig::SizeDistribution::kFixed:
+    break;
+  case SyntheticConfig::SizeDistribution::kUniform:
+    // In 64 bits: the full uint32 range has 2^32 sizes.
+    size += r % (uint64_t{config_.sizeB} - config_.sizeA + 1);
+    break;
+  case SyntheticConfig::SizeDistribution::kLognormal: {
+    // Box-Muller on two uniforms derived from the key.
+    const double u1 = 1 - toUnit(r);
+    const double u2 = toUnit(mix64(r));
+    const double normal =
+        std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2);
+    size *= std::exp(config_.sizeSigma * normal);
+    break;
+  }
+  }
+  return static_cast<uint32_t>(
+      std::clamp(size, 1.0, static_cast<double>(config_.maxSize)));
+}
+
+void SyntheticGenerator::generateChunk(uint64_t index,
+                                       std::vector<TraceEntry> &entries) const {
+  const uint64_t first = index * kChunkSize;
+  const uint64_t n = std::min(kChunkSize, config_.numRequests - first);
+  entries.resize(n);
+
+  std::mt19937_64 rng(mix64(config_.seed) ^ mix64(index + 1));
+  auto uniform = [&] { return toUnit(rng()); };
+
+  for (uint64_t i = 0; i < n; ++i) {
+    const uint64_t record = first + i;
+    const uint64_t rank = config_.alpha > 0
+                              ? zipf_.sample(uniform) - 1
+                              : rng() % config_.numKeys;
+    const uint64_t phase =
+        config_.phaseLength > 0 ? record / config_.phaseLength : 0;
+    const uint64_t keyId = (rank + phase * phaseShift_) % config_.numKeys;
+
+    auto &e = entries[i];
+    char buf[20];
+    auto [end, ec] = std::to_chars(std::begin(buf), std::end(buf), keyId);
+    e.key.assign(buf, end);
+
+    const double u = uniform();
+    e.op = u < config_.deleteRatio                      ? Op::kDelete
+           : u < config_.deleteRatio + config_.setRatio ? Op::kSet
+                                                        : Op::kGet;
+    e.size = sizeOf(keyId);
+    e.opCount = uniform() < config_.burstRatio
+                    ? 2 + rng() % (config_.maxBurst - 1)
+                    : 1;
+    e.timestamp =
+        config_.requestRate > 0 ? record / config_.requestRate : 0;
+    e.ttl = 0;
+  }
+}
+
+SyntheticTraceReader::SyntheticTraceReader(const SyntheticConfig &config)
+    : config_(config), generator_(config) {
+  const uint32_t numThreads =
+      config.numThreads > 0
+          ? config.numThreads
+          : std::max(1u, std::thread::hardware_concurrency());
+  slots_.resize(2 * numThreads);
+  for (uint32_t i = 0; i < numThreads; ++i) {
+    workers_.emplace_back([this] { run(); });
+  }
+}
+
+SyntheticTraceReader::~SyntheticTraceReader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void SyntheticTraceReader::run() {
+  while (true) {
+    uint64_t chunk;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (nextChunk_ == generator_.numChunks()) {
+        return;
+      }
+      chunk = nextChunk_++;
+      // The slot is free once the chunk one ring length back is consumed.
+      cv_.wait(lock,
+               [&] { return stop_ || chunk < numConsumed_ + slots_.size(); });
+      if (stop_) {
+        return;
+      }
+    }
+    auto &slot = slots_[chunk % slots_.size()];
+    generator_.generateChunk(chunk, slot.entries);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slot.ready = true;
+    }
+    cv_.notify_all();
+  }
+}
+
+bool SyntheticTraceReader::read(TraceEntry &e) {
+  if (numConsumed_ == generator_.numChunks()) {
+    return false;
+  }
+  auto &slot = slots_[numConsumed_ % slots_.size()];
+  if (!inChunk_) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return slot.ready; });
+    inChunk_ = true;
+    pos_ = 0;
+  }
+
+  e = slot.entries[pos_++];
+
+  if (pos_ == slot.entries.size()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slot.ready = false;
+      numConsumed_++;
+    }
+    cv_.notify_all();
+    inChunk_ = false;
+  }
+  return true;
+}
+
+uint64_t writeOracleGeneral(Trace &trace, const std::filesystem::path &path) {
+  std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+
+  uint64_t numRecords = 0;
+  Trace::Entry e;
+  while (trace.nextRequest(e)) {
+    if (e.op == Op::kDelete) {
+      continue;
+    }
+    uint64_t objId;
+    auto [end, ec] =
+        std::from_chars(e.key.data(), e.key.data() + e.key.size(), objId);
+    if (ec != std::errc() || end != e.key.data() + e.key.size()) {
+      objId = std::hash<std::string>{}(e.key);
+    }
+    const uint32_t clockTime = e.timestamp;
+    const int64_t nextAccessVtime = -1;
+
+    char record[24];
+    std::memcpy(record, &clockTime, 4);
+    std::memcpy(record + 4, &objId, 8);
+    std::memcpy(record + 12, &e.size, 4);
+    std::memcpy(record + 16, &nextAccessVtime, 8);
+    out.write(record, sizeof(record));
+    numRecords++;
+  }
+  return numRecords;
+}
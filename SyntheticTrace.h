@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "TraceReader.h"
+
+class Trace;
+
+// Parameters of a generated workload, given on the command line as a
+// comma-separated spec in place of a trace file, e.g.
+//   requests=1000000000,keys=100000000,alpha=0.9,size=lognormal:300:1.2
+struct SyntheticConfig {
+  enum class SizeDistribution { kFixed, kUniform, kLognormal };
+
+  // Trace records; a record may stand for several requests (opCount).
+  uint64_t numRequests{10'000'000};
+  uint64_t numKeys{1'000'000};
+  // Zipf exponent of key popularity; 0 is uniform.
+  double alpha{0.9};
+
+  // kFixed: sizeA bytes. kUniform: [sizeA, sizeB]. kLognormal: median
+  // sizeA, sigma sizeSigma. Sizes are fixed per key and clamped to
+  // [1, maxSize].
+  SizeDistribution sizeDistribution{SizeDistribution::kLognormal};
+  uint32_t sizeA{300};
+  uint32_t sizeB{0};
+  double sizeSigma{1.0};
+  uint32_t maxSize{1 << 20};
+
+  double deleteRatio{0.0};
+  double setRatio{0.0};
+  // Fraction of records repeated 2..maxBurst times (opCount).
+  double burstRatio{0.0};
+  uint32_t maxBurst{8};
+  // Every phaseLength records the popularity ranking shifts to other keys;
+  // 0 keeps it fixed.
+  uint64_t phaseLength{0};
+  // Timestamps advance at this many records per second; 0: no timestamps.
+  uint64_t requestRate{0};
+
+  uint64_t seed{1};
+  uint32_t numThreads{0}; // 0: hardware concurrency
+};
+
+// Throws std::invalid_argument on unknown keys or malformed values.
+SyntheticConfig parseSyntheticConfig(std::string_view spec);
+
+// Zipf(alpha) ranks in [1, n] by rejection-inversion (Hörmann and
+// Derflinger), O(1) expected time and no tables, for any alpha > 0.
+class ZipfSampler {
+public:
+  ZipfSampler(uint64_t n, double alpha);
+
+  // u is uniform in [0, 1); further uniforms come from next().
+  template <typename Uniform> uint64_t sample(Uniform &&next) const {
+    while (true) {
+      const double u = hIntegralN_ + next() * (hIntegralX1_ - hIntegralN_);
+      const double x = hIntegralInverse(u);
+      uint64_t k = static_cast<uint64_t>(x + 0.5);
+      k = std::clamp<uint64_t>(k, 1, n_);
+      if (k - x <= s_ || u >= hIntegral(k + 0.5) - h(k)) {
+        return k;
+      }
+    }
+  }
+
+private:
+  const uint64_t n_;
+  const double alpha_;
+  double hIntegralX1_;
+  double hIntegralN_;
+  double s_;
+
+  double h(double x) const;
+  double hIntegral(double x) const;
+  double hIntegralInverse(double x) const;
+};
+
+// Generates the workload in fixed-size chunks. A chunk depends only on the
+// config and its index, so the output is the same for any number of
+// threads.
+class SyntheticGenerator {
+public:
+  static constexpr uint64_t kChunkSize = 1 << 16;
+
+  explicit SyntheticGenerator(const SyntheticConfig &config);
+
+  uint64_t numChunks() const {
+    return (config_.numRequests + kChunkSize - 1) / kChunkSize;
+  }
+
+  void generateChunk(uint64_t index, std::vector<TraceEntry> &entries) const;
+
+private:
+  const SyntheticConfig config_;
+  const ZipfSampler zipf_;
+  const uint64_t phaseShift_;
+
+  uint32_t sizeOf(uint64_t keyId) const;
+};
+
+// Worker threads generate chunks ahead of the reader into a ring of slots;
+// chunks are handed out in order.
+class SyntheticTraceReader : public TraceReader {
+public:
+  explicit SyntheticTraceReader(const SyntheticConfig &config);
+  ~SyntheticTraceReader() override;
+
+  bool read(TraceEntry &e) override;
+
+  bool hasTimestamps() const override { return config_.requestRate > 0; }
+
+  // Slots are filled concurrently, so the ring is counted at full size.
+  void addMemoryUsage(MemoryUsage &usage) override {
+    const uint64_t numEntries = slots_.size() * SyntheticGenerator::kChunkSize;
+    usage.reservedBytes += numEntries * sizeof(TraceEntry);
+    usage.usedBytes += numEntries * sizeof(TraceEntry);
+    usage.numEntries += numEntries;
+  }
+
+private:
+  struct Slot {
+    std::vector<TraceEntry> entries;
+    bool ready{false};
+  };
+
+  const SyntheticConfig config_;
+  const SyntheticGenerator generator_;
+  std::vector<Slot> slots_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  uint64_t nextChunk_{0};
+  uint64_t numConsumed_{0};
+  bool stop_{false};
+
+  // Owned by the reading thread.
+  size_t pos_{0};
+  bool inChunk_{false};
+
+  void run();
+};
+
+// Writes the trace as libCacheSim oracleGeneral records and returns the
+// number written. The format has no op: GETs and SETs become requests and
+// DELETEs are dropped. Numeric keys are kept, others are hashed.
+uint64_t writeOracleGeneral(Trace &trace, const std::filesystem::path &path);
@@ -0,0 +1,164 @@
+#include "TagIndex.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+#include "SpecParser.h"
+#include "include/fmt/core.h"
+#include "include/robin_hood.h"
+
+namespace {
+
+constexpr std::string_view kSpecName = "flash index";
+
+} // namespace
+
+TagIndexConfig parseTagIndexConfig(std::string_view spec) {
+  TagIndexConfig config;
+  while (!spec.empty()) {
+    auto value = nextToken(spec, ',');
+    const auto key = nextToken(value, '=');
+    if (key == "buckets") {
+      config.numBuckets = parseSpecNumber<uint64_t>(kSpecName, key, value);
+    } else if (key == "object-size") {
+      config.objectSize = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "slots") {
+      config.slotsPerBucket = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "tag-bits") {
+      config.tagBits = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "offset-bits") {
+      config.offsetBits = parseSpecNumber<uint32_t>(kSpecName, key, value);
+    } else if (key == "charge-dram") {
+      config.chargeDram = true;
+    } else {
+      throw std::invalid_argument(
+          fmt::format("Unknown flash index parameter: {}", key));
+    }
+  }
+
+  if (config.slotsPerBucket == 0 || config.tagBits == 0 ||
+      config.tagBits > 32 || config.offsetBits > 64) {
+    throw std::invalid_argument("Inconsistent flash index parameters");
+  }
+  if (config.numBuckets == 0 && config.objectSize == 0) {
+    throw std::invalid_argument(
+        "Flash index needs buckets=N or object-size=BYTES");
+  }
+  return config;
+}
+
+namespace {
+
+uint64_t numBucketsFor(const TagIndexConfig &config, uint64_t numPages,
+                       uint32_t pageSize) {
+  if (config.numBuckets != 0) {
+    return config.numBuckets;
+  }
+  // Half-full buckets rarely overflow: with 16 slots, about 0.4% of them
+  // get more than 16 objects.
+  const uint64_t numObjects = numPages * pageSize / config.objectSize;
+  const uint64_t perBucket = std::max<uint64_t>(1, config.slotsPerBucket / 2);
+  return std::max<uint64_t>(1, (numObjects + perBucket - 1) / perBucket);
+}
+
+} // namespace
+
+TagIndexModel::TagIndexModel(const TagIndexConfig &config, uint64_t numPages,
+                             uint32_t pageSize)
+    : slotsPerBucket_(config.slotsPerBucket), tagBits_(config.tagBits),
+      offsetBits_(config.offsetBits != 0 ? config.offsetBits
+                                         : std::bit_width(numPages - 1)),
+      buckets_(numBucketsFor(config, numPages, pageSize)) {
+  if (offsetBits_ < 64 && (uint64_t{1} << offsetBits_) < numPages) {
+    throw std::invalid_argument(
+        fmt::format("{} offset bits cannot address {} flash pages",
+                    offsetBits_, numPages));
+  }
+}
+
+std::pair<uint64_t, uint32_t>
+TagIndexModel::locate(const std::string &key) const {
+  const uint64_t hash = robin_hood::hash_bytes(key.data(), key.size());
+  // High bits pick the bucket, low bits make the tag.
+  const uint64_t bucket = static_cast<uint64_t>(
+      (static_cast<unsigned __int128>(hash) * buckets_.size()) >> 64);
+  const uint32_t tag = hash & ((uint64_t{1} << tagBits_) - 1);
+  return {bucket, tag};
+}
+
+std::optional<std::string> TagIndexModel::insert(const std::string &key) {
+  const auto [bucketId, tag] = locate(key);
+  auto &bucket = buckets_[bucketId];
+  std::optional<std::string> evicted;
+  if (bucket.size() == slotsPerBucket_) {
+    evicted = std::move(bucket.front().key);
+    bucket.erase(std::begin(bucket));
+    numEntries_--;
+    numEvictions_++;
+  }
+  bucket.push_back({tag, key});
+  numEntries_++;
+  return evicted;
+}
+
+void TagIndexModel::remove(const std::string &key) {
+  auto &bucket = buckets_[locate(key).first];
+  auto it = std::find_if(std::begin(bucket), std::end(bucket),
+                         [&](const Entry &entry) { return entry.key == key; });
+  if (it != std::end(bucket)) {
+    bucket.erase(it);
+    numEntries_--;
+  }
+}
+
+void TagIndexModel::lookup(const std::string &key,
+                           FalseReadSink onFalseRead) {
+  const auto [bucketId, tag] = locate(key);
+  const auto &bucket = buckets_[bucketId];
+  numLookups_++;
+  // Newest entries are probed first.
+  uint64_t numFalseReads = 0;
+  for (auto it = std::rbegin(bucket); it != std::rend(bucket); ++it) {
+    if (it->tag != tag) {
+      continue;
+    }
+    if (it->key == key) {
+      break;
+    }
+    numFalseReads++;
+    onFalseRead(it->key);
+  }
+  numFalseReads_ += numFalseReads;
+  numLookupsWithFalseReads_ += numFalseReads > 0;
+}
+
+uint64_t TagIndexModel::tableBytes() const {
+  const uint64_t numSlots = buckets_.size() * slotsPerBucket_;
+  return (numSlots * (tagBits_ + offsetBits_) + 7) / 8;
+}
+
+void TagIndexModel::addMemoryUsage(MemoryUsage &usage) const {
+  usage.reservedBytes += tableBytes();
+  usage.usedBytes += (numEntries_ * (tagBits_ + offsetBits_) + 7) / 8;
+  usage.numEntries += numEntries_;
+}
+
+void TagIndexModel::report(std::ostream &os, uint64_t numObjects) const {
+  const uint64_t bytes = tableBytes();
+  os << fmt::format("Flash index: {} buckets x {} slots of {}+{} bits, "
+                    "{:.2f} MB DRAM, {:.2f} bytes per cached object",
+                    buckets_.size(), slotsPerBucket_, tagBits_, offsetBits_,
+                    bytes / (1024.0 * 1024.0),
+                    numObjects > 0 ? static_cast<double>(bytes) / numObjects
+                                   : 0.0)
+     << std::endl;
+  os << fmt::format("Flash index: {} false-positive reads ({:.4f} per lookup, "
+                    "{} lookups affected), {} objects dropped by full buckets",
+                    numFalseReads_,
+                    numLookups_ > 0
+                        ? static_cast<double>(numFalseReads_) / numLookups_
+                        : 0.0,
+                    numLookupsWithFalseReads_, numEvictions_)
+     << std::endl;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "FunctionRef.h"
+#include "MemoryResource.h"
+
+// Geometry of the modelled flash index, given on the command line as a
+// comma-separated spec, e.g.
+//   tag-bits=12,slots=16,object-size=300,charge-dram
+// Either the bucket count or the average object size must be given.
+struct TagIndexConfig {
+  // 0: sized from objectSize.
+  uint64_t numBuckets{0};
+  // Average object size in bytes; the buckets are sized to be half full
+  // when the flash is full of such objects.
+  uint32_t objectSize{0};
+  uint32_t slotsPerBucket{16};
+  uint32_t tagBits{12};
+  // 0: just enough bits to address every flash page.
+  uint32_t offsetBits{0};
+  // Take the DRAM of the index out of the DRAM cache capacity.
+  bool chargeDram{false};
+};
+
+// Throws std::invalid_argument on unknown keys or malformed values.
+TagIndexConfig parseTagIndexConfig(std::string_view spec);
+
+// DRAM index of a real flash cache: fixed-size buckets of (tag, page
+// offset) entries instead of full keys. The key hash picks the bucket and
+// the tag. A lookup reads the flash page of every entry with a matching tag
+// until it finds the key, so entries of other keys with the same tag cost
+// false-positive flash reads. A full bucket drops its oldest entry, and the
+// object it pointed to becomes unreachable on flash.
+//
+// Full keys are kept next to the entries to tell true matches from false
+// ones; only the entries count as DRAM.
+class TagIndexModel {
+public:
+  // Receives the key of every entry a lookup reads in vain.
+  using FalseReadSink = FunctionRef<void(const std::string &)>;
+
+  // numPages: flash pages the offsets have to address.
+  TagIndexModel(const TagIndexConfig &config, uint64_t numPages,
+                uint32_t pageSize);
+
+  // Returns the key whose entry was dropped to make room, if any. key must
+  // not be indexed already.
+  std::optional<std::string> insert(const std::string &key);
+
+  void remove(const std::string &key);
+
+  // Accounts the flash reads a lookup of key costs beyond the true one.
+  void lookup(const std::string &key, FalseReadSink onFalseRead);
+
+  // Modelled DRAM footprint of the whole table.
+  uint64_t tableBytes() const;
+
+  void addMemoryUsage(MemoryUsage &usage) const;
+
+  // numObjects: objects cached on flash, to get DRAM bytes per object.
+  void report(std::ostream &os, uint64_t numObjects) const;
+
+private:
+  struct Entry {
+    uint32_t tag;
+    std::string key;
+  };
+
+  const uint32_t slotsPerBucket_;
+  const uint32_t tagBits_;
+  const uint32_t offsetBits_;
+  // Oldest entry first.
+  std::vector<std::vector<Entry>> buckets_;
+  uint64_t numEntries_{0};
+
+  uint64_t numLookups_{0};
+  uint64_t numFalseReads_{0};
+  uint64_t numLookupsWithFalseReads_{0};
+  uint64_t numEvictions_{0};
+
+  // Bucket index and tag of key.
+  std::pair<uint64_t, uint32_t> locate(const std::string &key) const;
+};
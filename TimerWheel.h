@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MemoryResource.h"
+
+// Hashed timer wheel with one-second slots used for proactive TTL expiry.
+// Entries are never cancelled: the owner validates each fired entry against
+// the item's current expiry time, so updates and removals just leave stale
+// entries behind that are dropped when their slot comes around. Expiry
+// times beyond one lap of the wheel are re-slotted until they are due.
+class TimerWheel {
+public:
+  explicit TimerWheel(uint32_t numSlots = 4096) : slots_(numSlots) {}
+
+  void schedule(const std::string &key, uint32_t expiryTime) {
+    slots_[expiryTime % slots_.size()].push_back({key, expiryTime});
+    numScheduled_++;
+  }
+
+  // Fires onExpire(key, expiryTime) for every entry due at or before now.
+  template <typename Fn> void advance(uint32_t now, Fn &&onExpire) {
+    if (now <= lastAdvanced_) {
+      return;
+    }
+    const uint64_t numSteps =
+        std::min<uint64_t>(now - lastAdvanced_, slots_.size());
+    for (uint64_t step = 1; step <= numSteps; ++step) {
+      auto &slot = slots_[(lastAdvanced_ + step) % slots_.size()];
+      if (slot.empty()) {
+        continue;
+      }
+      firing_.swap(slot);
+      for (auto &entry : firing_) {
+        if (entry.expiryTime <= now) {
+          numScheduled_--;
+          onExpire(entry.key, entry.expiryTime);
+        } else {
+          slot.push_back(std::move(entry));
+        }
+      }
+      firing_.clear();
+    }
+    lastAdvanced_ = now;
+  }
+
+  uint64_t size() const { return numScheduled_; }
+
+  // Stale entries count too: they hold memory until their slot fires.
+  void addMemoryUsage(MemoryUsage &usage) const {
+    usage.reservedBytes += slots_.capacity() * sizeof(slots_[0]) +
+                           firing_.capacity() * sizeof(Entry);
+    usage.usedBytes += slots_.size() * sizeof(slots_[0]);
+    for (const auto &slot : slots_) {
+      usage.reservedBytes += slot.capacity() * sizeof(Entry);
+      usage.usedBytes += slot.size() * sizeof(Entry);
+    }
+    usage.numEntries += numScheduled_;
+  }
+
+private:
+  struct Entry {
+    std::string key;
+    uint32_t expiryTime;
+  };
+
+  std::vector<std::vector<Entry>> slots_;
+  std::vector<Entry> firing_;
+  uint32_t lastAdvanced_{0};
+  uint64_t numScheduled_{0};
+};
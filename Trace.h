@@ -1,81 +1,97 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
 #include <filesystem>
 #include <iostream>
 #include <memory>
 #include <optional>
 #include <vector>
 
-#include "include/csv.h"
+#include "Profile.h"
+#include "TraceReader.h"
 #include "include/fmt/core.h"
 
 class Trace {
 public:
-  struct Entry {
-    std::string key;
-    std::string op;
-    uint32_t size;
-    uint32_t opCount;
-    bool isGet;
-  };
-  Trace(const std::vector<std::string> &paths)
-      : traceFilePaths(paths), recentEntry{"", "", 0, 0}, recentOpCount(0),
-        traceFileIndex(0) {
+  using Entry = TraceEntry;
+
+  // SETs are skipped unless replaySets is true, matching the GET/DELETE
+  // only replay of earlier versions. GETs and SETs of objects larger than
+  // maxObjectSize are skipped.
+  Trace(const std::vector<std::string> &paths,
+        TraceFormat format = TraceFormat::kCsv, bool replaySets = false,
+        uint32_t maxObjectSize = TraceReader::kDefaultMaxObjectSize)
+      : traceFilePaths(paths), format(format), replaySets(replaySets),
+        maxObjectSize(maxObjectSize), recentEntry{"", Op::kOther, 0, 0, 0, 0},
+        recentOpCount(0), traceFileIndex(0) {
     std::sort(std::begin(traceFilePaths), std::end(traceFilePaths));
-    csvFile = std::make_unique<io::CSVReader<4>>(nextTraceFilePath().value());
-    csvFile->read_header(io::ignore_extra_column, "key", "size", "op",
-                         "op_count");
+    openReader(nextTraceFilePath().value());
   }
 
   bool nextRequest(Entry &e) {
+    PROFILE_SCOPE(kTraceParse);
     if (recentOpCount > 0) {
       e = recentEntry;
       recentOpCount--;
       return true;
     }
 
-    bool isValid = false;
-    do {
-      isValid = csvFile->read_row(e.key, e.size, e.op, e.opCount);
-      assert(e.opCount > 0);
-      if (isValid) {
-        recentEntry = e;
-        recentOpCount = e.opCount - 1;
-      }
-    } while (isValid && !isTargetRequest(e));
+    bool isValid = readTargetRequest(e);
 
     if (!isValid) {
       if (auto nextFile = nextTraceFilePath()) {
         std::cout << fmt::format("Processing next file: {}",
                                  nextFile.value().string())
                   << std::endl;
-        csvFile = std::make_unique<io::CSVReader<4>>(nextFile.value());
-        csvFile->read_header(io::ignore_extra_column, "key", "size", "op",
-                             "op_count");
-        do {
-          isValid = csvFile->read_row(e.key, e.size, e.op, e.opCount);
-          assert(e.opCount > 0);
-          if (isValid) {
-            recentEntry = e;
-            recentOpCount = e.opCount - 1;
-          }
-        } while (isValid && !isTargetRequest(e));
+        openReader(nextFile.value());
+        isValid = readTargetRequest(e);
       }
     }
     return isValid;
   }
 
+  // True if the trace carries timestamps (in seconds) that can drive the
+  // simulated clock.
+  bool hasTimestamps() const { return reader->hasTimestamps(); }
+
+  void appendMemoryUsage(std::vector<MemoryUsage> &usage) {
+    reader->addMemoryUsage(
+        usage.emplace_back(MemoryUsage{.table = "trace.reader"}));
+  }
+
 private:
   std::vector<std::string> traceFilePaths;
-  std::unique_ptr<io::CSVReader<4>> csvFile;
+  const TraceFormat format;
+  const bool replaySets;
+  const uint32_t maxObjectSize;
+  std::unique_ptr<TraceReader> reader;
 
   Entry recentEntry;
   uint32_t recentOpCount;
 
   uint32_t traceFileIndex;
 
+  void openReader(const std::filesystem::path &path) {
+    reader = makeTraceReader(format, path);
+    reader->setMaxObjectSize(maxObjectSize);
+  }
+
+  bool readTargetRequest(Entry &e) {
+    bool isValid = false;
+    do {
+      isValid = reader->read(e);
+      assert(!isValid || e.opCount > 0);
+      if (isValid) {
+        recentEntry = e;
+        recentOpCount = e.opCount - 1;
+      }
+    } while (isValid && !isTargetRequest(e));
+    return isValid;
+  }
+
   bool isTargetRequest(const Entry &e) const {
-    return (e.op.front() == 'G' && e.size <= 2048) || e.op.front() == 'D';
+    return reader->isTargetRequest(e) && (replaySets || e.op != Op::kSet);
   }
 
   std::optional<std::filesystem::path> nextTraceFilePath() {
@@ -0,0 +1,433 @@
+#include "TraceReader.h"
+
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "DecompressingSource.h"
+#include "SyntheticTrace.h"
+#include "include/fmt/core.h"
+
+bool TraceSource::nextLine(std::string_view &line) {
+  while (true) {
+    auto w = window();
+    if (auto pos = w.find('\n'); pos != std::string_view::npos) {
+      line = w.substr(0, pos);
+      consume(pos + 1);
+      break;
+    }
+    if (!refill()) {
+      if (w.empty()) {
+        return false;
+      }
+      line = w;
+      consume(w.size());
+      break;
+    }
+  }
+  if (!line.empty() && line.back() == '\r') {
+    line.remove_suffix(1);
+  }
+  return true;
+}
+
+bool TraceSource::nextRecord(size_t n, const char *&record) {
+  while (window().size() < n) {
+    if (!refill()) {
+      return false;
+    }
+  }
+  record = cur_;
+  consume(n);
+  return true;
+}
+
+MappedFileSource::MappedFileSource(const std::filesystem::path &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to stat file: " + path.string());
+  }
+  length_ = static_cast<size_t>(st.st_size);
+  if (length_ > 0) {
+    addr_ = ::mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr_ == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Failed to mmap file: " + path.string());
+    }
+    ::madvise(addr_, length_, MADV_SEQUENTIAL);
+    cur_ = static_cast<const char *>(addr_);
+    end_ = cur_ + length_;
+  }
+  ::close(fd);
+}
+
+MappedFileSource::~MappedFileSource() {
+  if (addr_ != nullptr) {
+    ::munmap(addr_, length_);
+  }
+}
+
+namespace {
+
+template <typename T> T parseNumber(std::string_view field, const char *what) {
+  T value{};
+  auto [ptr, ec] =
+      std::from_chars(field.data(), field.data() + field.size(), value);
+  if (ec != std::errc()) {
+    throw std::runtime_error(
+        fmt::format("Invalid {} field in trace: '{}'", what, field));
+  }
+  return value;
+}
+
+// Strips the spaces and tabs around a field, as csv.h's trim_chars did.
+std::string_view trimField(std::string_view field) {
+  constexpr std::string_view kBlanks = " \t";
+  const auto begin = field.find_first_not_of(kBlanks);
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  return field.substr(begin, field.find_last_not_of(kBlanks) - begin + 1);
+}
+
+// Splits line on ',' into at most fields.size() trimmed views; returns field
+// count.
+template <size_t N>
+size_t splitFields(std::string_view line,
+                   std::array<std::string_view, N> &fields) {
+  size_t n = 0;
+  while (n < N) {
+    auto pos = line.find(',');
+    fields[n++] = trimField(line.substr(0, pos));
+    if (pos == std::string_view::npos) {
+      break;
+    }
+    line.remove_prefix(pos + 1);
+  }
+  return n;
+}
+
+// GET, GET_LEASE, SET, SET_LEASE, DELETE, ... as used by our own traces and
+// CacheLib's kvcache traces.
+Op opFromUpperName(std::string_view op) {
+  if (op.empty()) {
+    return Op::kOther;
+  }
+  switch (op.front()) {
+  case 'G':
+    return Op::kGet;
+  case 'S':
+    return Op::kSet;
+  case 'D':
+    return Op::kDelete;
+  default:
+    return Op::kOther;
+  }
+}
+
+// CSV with a header naming the columns. Our own format and CacheLib's
+// kvcache format only differ in column names and in how the object size is
+// composed, so both are handled here.
+class HeaderCsvReader : public TraceReader {
+public:
+  struct Columns {
+    const char *key;
+    const char *size;
+    const char *keySize; // optional, added to size when present
+    const char *op;
+    const char *opCount;
+    const char *timestamp;
+    const char *ttl;
+  };
+
+  HeaderCsvReader(std::unique_ptr<TraceSource> source, const Columns &columns,
+                  const std::filesystem::path &path)
+      : source_(std::move(source)) {
+    std::string_view header;
+    if (!source_->nextLine(header)) {
+      throw std::runtime_error("Empty trace file: " + path.string());
+    }
+    std::array<std::string_view, kMaxFields> names;
+    numFields_ = splitFields(header, names);
+    roles_.fill(Role::kIgnore);
+
+    const std::array<std::pair<const char *, Role>, 7> wanted = {{
+        {columns.key, Role::kKey},
+        {columns.size, Role::kSize},
+        {columns.keySize, Role::kKeySize},
+        {columns.op, Role::kOp},
+        {columns.opCount, Role::kOpCount},
+        {columns.timestamp, Role::kTimestamp},
+        {columns.ttl, Role::kTtl},
+    }};
+    for (size_t i = 0; i < numFields_; ++i) {
+      for (const auto &[name, role] : wanted) {
+        if (name != nullptr && names[i] == name) {
+          roles_[i] = role;
+          found_[static_cast<size_t>(role)] = true;
+        }
+      }
+    }
+    for (const auto &[name, role] : {wanted[0], wanted[1], wanted[3]}) {
+      if (!found_[static_cast<size_t>(role)]) {
+        throw std::runtime_error(fmt::format(
+            "Missing column '{}' in trace file {}", name, path.string()));
+      }
+    }
+  }
+
+  bool read(TraceEntry &e) override {
+    std::string_view line;
+    do {
+      if (!source_->nextLine(line)) {
+        return false;
+      }
+    } while (line.empty());
+
+    std::array<std::string_view, kMaxFields> fields;
+    const size_t n = splitFields(line, fields);
+    e.size = 0;
+    e.opCount = 1;
+    e.timestamp = 0;
+    e.ttl = 0;
+    e.op = Op::kOther;
+    for (size_t i = 0; i < n; ++i) {
+      const auto field = fields[i];
+      switch (roles_[i]) {
+      case Role::kKey:
+        e.key.assign(field);
+        break;
+      case Role::kSize:
+        e.size += parseNumber<uint32_t>(field, "size");
+        break;
+      case Role::kKeySize:
+        e.size += parseNumber<uint32_t>(field, "key_size");
+        break;
+      case Role::kOp:
+        e.op = opFromUpperName(field);
+        break;
+      case Role::kOpCount:
+        e.opCount = parseNumber<uint32_t>(field, "op_count");
+        break;
+      case Role::kTimestamp:
+        e.timestamp = parseNumber<uint64_t>(field, "timestamp");
+        break;
+      case Role::kTtl:
+        e.ttl = field.empty() ? 0 : parseNumber<uint32_t>(field, "ttl");
+        break;
+      case Role::kIgnore:
+        break;
+      }
+    }
+    return true;
+  }
+
+  bool hasTimestamps() const override {
+    return found_[static_cast<size_t>(Role::kTimestamp)];
+  }
+
+  void addMemoryUsage(MemoryUsage &usage) override {
+    source_->addMemoryUsage(usage);
+  }
+
+private:
+  static constexpr size_t kMaxFields = 16;
+
+  enum class Role : uint8_t {
+    kKey,
+    kSize,
+    kKeySize,
+    kOp,
+    kOpCount,
+    kTimestamp,
+    kTtl,
+    kIgnore,
+  };
+
+  std::unique_ptr<TraceSource> source_;
+  size_t numFields_{0};
+  std::array<Role, kMaxFields> roles_;
+  std::array<bool, static_cast<size_t>(Role::kIgnore)> found_{};
+};
+
+// https://github.com/twitter/cache-trace
+// timestamp,anonymized key,key size,value size,client id,operation,TTL
+class TwitterReader : public TraceReader {
+public:
+  explicit TwitterReader(std::unique_ptr<TraceSource> source)
+      : source_(std::move(source)) {}
+
+  bool read(TraceEntry &e) override {
+    std::string_view line;
+    std::array<std::string_view, 7> fields;
+    do {
+      if (!source_->nextLine(line)) {
+        return false;
+      }
+    } while (line.empty() || splitFields(line, fields) < 7);
+
+    e.timestamp = parseNumber<uint64_t>(fields[0], "timestamp");
+    e.key.assign(fields[1]);
+    const uint32_t keySize = parseNumber<uint32_t>(fields[2], "key size");
+    const uint32_t valueSize = parseNumber<uint32_t>(fields[3], "value size");
+    e.size = keySize + valueSize;
+    e.op = opFromName(fields[5]);
+    // A get without a value size tells us nothing about the object.
+    if (e.op == Op::kGet && valueSize == 0) {
+      e.op = Op::kOther;
+    }
+    e.opCount = 1;
+    e.ttl = parseNumber<uint32_t>(fields[6], "TTL");
+    return true;
+  }
+
+  bool hasTimestamps() const override { return true; }
+
+  void addMemoryUsage(MemoryUsage &usage) override {
+    source_->addMemoryUsage(usage);
+  }
+
+private:
+  std::unique_ptr<TraceSource> source_;
+
+  static Op opFromName(std::string_view op) {
+    if (op == "get" || op == "gets") {
+      return Op::kGet;
+    }
+    if (op == "delete") {
+      return Op::kDelete;
+    }
+    if (op == "set" || op == "add" || op == "replace" || op == "cas" ||
+        op == "append" || op == "prepend" || op == "incr" || op == "decr") {
+      return Op::kSet;
+    }
+    return Op::kOther;
+  }
+};
+
+// libCacheSim oracleGeneral: packed little-endian records of
+// uint32 clock_time, uint64 obj_id, uint32 obj_size, int64 next_access_vtime.
+// The format has no operation field, so every record is a GET.
+class OracleGeneralReader : public TraceReader {
+public:
+  static constexpr size_t kRecordSize = 24;
+
+  explicit OracleGeneralReader(std::unique_ptr<TraceSource> source)
+      : source_(std::move(source)) {}
+
+  bool read(TraceEntry &e) override {
+    const char *record;
+    if (!source_->nextRecord(kRecordSize, record)) {
+      return false;
+    }
+    uint32_t clockTime;
+    uint64_t objId;
+    uint32_t objSize;
+    std::memcpy(&clockTime, record, sizeof(clockTime));
+    std::memcpy(&objId, record + 4, sizeof(objId));
+    std::memcpy(&objSize, record + 12, sizeof(objSize));
+
+    char buf[20];
+    auto [end, ec] = std::to_chars(std::begin(buf), std::end(buf), objId);
+    e.key.assign(buf, end);
+    e.op = Op::kGet;
+    e.size = objSize;
+    e.opCount = 1;
+    e.timestamp = clockTime;
+    e.ttl = 0;
+    return true;
+  }
+
+  bool isTargetRequest(const TraceEntry &e) const override {
+    return e.size > 0 && TraceReader::isTargetRequest(e);
+  }
+
+  bool hasTimestamps() const override { return true; }
+
+  void addMemoryUsage(MemoryUsage &usage) override {
+    source_->addMemoryUsage(usage);
+  }
+
+private:
+  std::unique_ptr<TraceSource> source_;
+};
+
+} // namespace
+
+std::optional<TraceFormat> parseTraceFormat(std::string_view name) {
+  if (name == "csv") {
+    return TraceFormat::kCsv;
+  }
+  if (name == "twitter") {
+    return TraceFormat::kTwitter;
+  }
+  if (name == "oracle" || name == "oracleGeneral") {
+    return TraceFormat::kOracleGeneral;
+  }
+  if (name == "kvcache") {
+    return TraceFormat::kKvcache;
+  }
+  if (name == "synthetic") {
+    return TraceFormat::kSynthetic;
+  }
+  return std::nullopt;
+}
+
+std::unique_ptr<TraceSource> openTraceSource(const std::filesystem::path &path) {
+  const auto compression = detectCompression(path);
+  if (compression == Compression::kNone) {
+    return std::make_unique<MappedFileSource>(path);
+  }
+  return std::make_unique<DecompressingSource>(path, compression);
+}
+
+std::unique_ptr<TraceReader> makeTraceReader(TraceFormat format,
+                                             const std::filesystem::path &path) {
+  if (format == TraceFormat::kSynthetic) {
+    return std::make_unique<SyntheticTraceReader>(
+        parseSyntheticConfig(path.string()));
+  }
+  auto source = openTraceSource(path);
+  switch (format) {
+  case TraceFormat::kCsv:
+    return std::make_unique<HeaderCsvReader>(
+        std::move(source),
+        HeaderCsvReader::Columns{.key = "key",
+                                 .size = "size",
+                                 .keySize = nullptr,
+                                 .op = "op",
+                                 .opCount = "op_count",
+                                 .timestamp = "timestamp",
+                                 .ttl = "ttl"},
+        path);
+  case TraceFormat::kKvcache:
+    return std::make_unique<HeaderCsvReader>(
+        std::move(source),
+        HeaderCsvReader::Columns{.key = "key",
+                                 .size = "size",
+                                 .keySize = "key_size",
+                                 .op = "op",
+                                 .opCount = "op_count",
+                                 .timestamp = "op_time",
+                                 .ttl = "ttl"},
+        path);
+  case TraceFormat::kTwitter:
+    return std::make_unique<TwitterReader>(std::move(source));
+  case TraceFormat::kOracleGeneral:
+    return std::make_unique<OracleGeneralReader>(std::move(source));
+  case TraceFormat::kSynthetic:
+    break;
+  }
+  return nullptr;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "MemoryResource.h"
+
+enum class Op : uint8_t { kGet, kSet, kDelete, kOther };
+
+struct TraceEntry {
+  std::string key;
+  Op op;
+  uint32_t size;
+  uint32_t opCount;
+  // Optional fields; 0 when the trace does not provide them.
+  uint64_t timestamp;
+  uint32_t ttl;
+};
+
+// Window of raw trace bytes. Readers parse records straight out of the
+// window and consume() them; refill() makes more bytes available and may
+// move the window, so views into it are only valid until the next refill.
+class TraceSource {
+public:
+  virtual ~TraceSource() = default;
+
+  std::string_view window() const {
+    return {cur_, static_cast<size_t>(end_ - cur_)};
+  }
+
+  void consume(size_t n) { cur_ += n; }
+
+  // Returns false once the input is exhausted.
+  virtual bool refill() = 0;
+
+  // Next '\n'-terminated line without the terminator (and a trailing '\r').
+  bool nextLine(std::string_view &line);
+
+  // Next fixed-size binary record; false if fewer than n bytes remain.
+  bool nextRecord(size_t n, const char *&record);
+
+  // Trace bytes held in memory.
+  virtual void addMemoryUsage(MemoryUsage &) {}
+
+protected:
+  const char *cur_{nullptr};
+  const char *end_{nullptr};
+};
+
+// Whole file mapped read-only; the window is the entire file.
+class MappedFileSource : public TraceSource {
+public:
+  explicit MappedFileSource(const std::filesystem::path &path);
+  ~MappedFileSource() override;
+
+  bool refill() override { return false; }
+
+  // The mapping is reserved; the part parsed so far is counted as used.
+  void addMemoryUsage(MemoryUsage &usage) override {
+    usage.reservedBytes += length_;
+    usage.usedBytes += cur_ - static_cast<const char *>(addr_);
+  }
+
+private:
+  void *addr_{nullptr};
+  size_t length_{0};
+};
+
+class TraceReader {
+public:
+  virtual ~TraceReader() = default;
+
+  // Decodes the next record into e. Returns false at end of input.
+  virtual bool read(TraceEntry &e) = 0;
+
+  // Format-specific filter deciding which records are replayed.
+  virtual bool isTargetRequest(const TraceEntry &e) const {
+    return ((e.op == Op::kGet || e.op == Op::kSet) &&
+            e.size <= maxObjectSize) ||
+           e.op == Op::kDelete;
+  }
+
+  virtual bool hasTimestamps() const = 0;
+
+  // Buffers of the reader and its source.
+  virtual void addMemoryUsage(MemoryUsage &) {}
+
+  void setMaxObjectSize(uint32_t size) { maxObjectSize = size; }
+
+  static constexpr uint32_t kDefaultMaxObjectSize = 2048;
+
+protected:
+  uint32_t maxObjectSize{kDefaultMaxObjectSize};
+};
+
+enum class TraceFormat {
+  // key,size,op,op_count[,timestamp,ttl] with header (our own format)
+  kCsv,
+  // Twitter cluster traces: timestamp,key,key size,value size,client id,
+  // operation,TTL without header
+  kTwitter,
+  // libCacheSim oracleGeneral binary records
+  kOracleGeneral,
+  // Meta CacheLib kvcache CSV with header
+  kKvcache,
+  // Generated workload; the "file" is a SyntheticConfig spec
+  kSynthetic,
+};
+
+std::optional<TraceFormat> parseTraceFormat(std::string_view name);
+
+// Maps plain files; gzip, zstd and lz4 files (detected by their magic
+// bytes) are decompressed on a background thread while being parsed.
+std::unique_ptr<TraceSource> openTraceSource(const std::filesystem::path &path);
+
+std::unique_ptr<TraceReader> makeTraceReader(TraceFormat format,
+                                             const std::filesystem::path &path);
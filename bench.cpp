@@ -0,0 +1,343 @@
+#define FMT_HEADER_ONLY
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <streambuf>
+#include <sys/resource.h>
+
+#include "DRAMCache.h"
+#include "Profile.h"
+#include "Sim.h"
+#include "Trace.h"
+#include "fifo.h"
+#include "include/argparse.h"
+#include "include/fmt/core.h"
+
+// Microbenchmarks of the replay hot paths. Each benchmark prints one CSV
+// row: name, operations, ns/op, heap allocations/op and the peak RSS of the
+// process so far. Allocations are counted through the global operator new,
+// so robin_hood tables (which call malloc directly) do not show up.
+
+namespace {
+
+#ifdef SIM_PROFILE
+// The profiler replaces operator new then (Profile.cpp); bench runs on one
+// thread, so its slot holds every allocation.
+uint64_t numAllocationsSoFar() {
+  return profileSlot()
+      .counters[static_cast<int>(ProfileCounter::kAllocations)]
+      .load(std::memory_order_relaxed);
+}
+#else
+std::atomic<uint64_t> numAllocations{0};
+
+uint64_t numAllocationsSoFar() { return numAllocations.load(); }
+
+// Counts the allocation; 0 alignment: malloc's default.
+void *allocate(size_t n, size_t alignment) {
+  numAllocations.fetch_add(1, std::memory_order_relaxed);
+  n = n ? n : 1;
+  void *p = nullptr;
+  if (alignment == 0) {
+    p = std::malloc(n);
+  } else if (posix_memalign(&p, std::max(alignment, sizeof(void *)), n) != 0) {
+    p = nullptr;
+  }
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+#endif
+
+// Rows go here (stdout); std::cout itself is silenced so that what the code
+// under test prints does not end up in the output.
+std::ostream results(nullptr);
+
+struct NullBuffer : std::streambuf {
+  int overflow(int c) override { return c; }
+};
+
+uint64_t peakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+std::vector<std::string> makeKeys(const std::string &prefix, uint64_t n) {
+  std::vector<std::string> keys;
+  keys.reserve(n);
+  for (uint64_t i = 0; i < n; ++i) {
+    keys.push_back(fmt::format("{}{}", prefix, i));
+  }
+  return keys;
+}
+
+// Runs fn, which performs numOps operations, and prints its row.
+template <typename Fn>
+void measure(const std::string &name, uint64_t numOps, Fn &&fn) {
+  const uint64_t allocsBefore = numAllocationsSoFar();
+  const auto start = std::chrono::steady_clock::now();
+  fn();
+  const auto end = std::chrono::steady_clock::now();
+  const uint64_t allocs = numAllocationsSoFar() - allocsBefore;
+
+  const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  results << fmt::format("{},{},{:.1f},{:.3f},{}", name, numOps,
+                           ns / numOps, static_cast<double>(allocs) / numOps,
+                           peakRssKb())
+            << std::endl;
+}
+
+void benchDramCache(uint64_t numOps) {
+  constexpr uint32_t kSize = 100;
+  constexpr uint64_t kNumKeys = 100000;
+  const auto keys = makeKeys("key", kNumKeys);
+  const auto missKeys = makeKeys("miss", numOps);
+
+  Stat stat;
+  Clock clock;
+  auto dropVictim = [](const DRAMCache::Item &) {};
+  {
+    DRAMCache cache(stat, clock, kNumKeys * kSize * 2);
+    for (const auto &key : keys) {
+      cache.insert(key, kSize, false, 0, dropVictim);
+    }
+    measure("dram_lookup_hit", numOps, [&] {
+      for (uint64_t i = 0; i < numOps; ++i) {
+        cache.lookup(keys[i % kNumKeys]);
+      }
+    });
+    measure("dram_lookup_miss", numOps, [&] {
+      for (uint64_t i = 0; i < numOps; ++i) {
+        cache.lookup(missKeys[i]);
+      }
+    });
+  }
+  {
+    DRAMCache cache(stat, clock, kNumKeys * kSize);
+    for (const auto &key : keys) {
+      cache.insert(key, kSize, false, 0, dropVictim);
+    }
+    // Every insert evicts the LRU item.
+    measure("dram_insert_evict", numOps, [&] {
+      for (uint64_t i = 0; i < numOps; ++i) {
+        cache.insert(missKeys[i], kSize, false, 0, dropVictim);
+      }
+    });
+  }
+}
+
+void benchFifo(uint64_t numOps) {
+  Stat stat;
+  Clock clock;
+  const auto keys = makeKeys("key", numOps);
+  auto item = [&](uint64_t i, uint32_t size) {
+    return DRAMCache::Item{.key = keys[i],
+                           .size = size,
+                           .numAccesses = 0,
+                           .isInFifo = false,
+                           .expiryTime = 0};
+  };
+
+  {
+    // Tiny items: every segment rotation clears thousands of victims.
+    auto fifo = Fifo::create(stat, clock, 32 * Fifo::kDefaultSegmentSize,
+                             "/dev/null", "/dev/null");
+    measure("fifo_insert_small_items", numOps, [&] {
+      for (uint64_t i = 0; i < numOps; ++i) {
+        fifo->insert(item(i, 16));
+      }
+    });
+  }
+  {
+    constexpr uint32_t kSize = 200;
+    const uint64_t numKeys = std::min<uint64_t>(numOps, 100000);
+    auto fifo = Fifo::create(stat, clock, numKeys * 2 * (kSize + 20),
+                             "/dev/null", "/dev/null");
+    for (uint64_t i = 0; i < numKeys; ++i) {
+      fifo->insert(item(i, kSize));
+    }
+    measure("fifo_lookup_hit", numOps, [&] {
+      for (uint64_t i = 0; i < numOps; ++i) {
+        fifo->lookup(keys[i % numKeys]);
+      }
+    });
+    measure("fifo_lookup_miss", numOps - numKeys, [&] {
+      for (uint64_t i = numKeys; i < numOps; ++i) {
+        fifo->lookup(keys[i]);
+      }
+    });
+  }
+}
+
+void benchTraceDecode(uint64_t numOps, const std::filesystem::path &dir) {
+  const auto csvFile = dir / "bench_trace.csv";
+  const auto binFile = dir / "bench_trace.bin";
+  {
+    std::ofstream csv(csvFile);
+    std::ofstream bin(binFile, std::ios::binary);
+    csv << "key,size,op,op_count,timestamp,ttl\n";
+    for (uint64_t i = 0; i < numOps; ++i) {
+      const uint64_t key = (i * 2654435761u) % (numOps / 4 + 1);
+      const uint32_t size = 50 + key % 1000;
+      csv << fmt::format("k{},{},GET,1,{},0\n", key, size, i / 1000);
+
+      char record[24] = {};
+      const uint32_t clockTime = i / 1000;
+      std::memcpy(record, &clockTime, 4);
+      std::memcpy(record + 4, &key, 8);
+      std::memcpy(record + 12, &size, 4);
+      bin.write(record, sizeof(record));
+    }
+  }
+
+  auto decode = [&](const std::string &name,
+                    const std::filesystem::path &path, TraceFormat format) {
+    measure(name, numOps, [&] {
+      Trace trace({path.string()}, format);
+      Trace::Entry e;
+      uint64_t n = 0;
+      while (trace.nextRequest(e)) {
+        n++;
+      }
+      if (n != numOps) {
+        std::cerr << name << ": decoded " << n << " requests" << std::endl;
+      }
+    });
+  };
+  decode("trace_decode_csv", csvFile, TraceFormat::kCsv);
+  decode("trace_decode_oracle", binFile, TraceFormat::kOracleGeneral);
+
+  std::filesystem::remove(csvFile);
+  std::filesystem::remove(binFile);
+}
+
+// End-to-end replay of a real trace through the simulator.
+void benchReplay(const std::string &path, TraceFormat format,
+                 uint64_t dramSize, uint64_t fifoSize) {
+  std::vector<Trace::Entry> entries;
+  {
+    Trace trace({path}, format);
+    Trace::Entry e;
+    while (trace.nextRequest(e)) {
+      entries.push_back(e);
+    }
+  }
+
+  Simulator sim(fifoSize, "/dev/null", "/dev/null", dramSize);
+  measure("replay", entries.size(), [&] {
+    for (const auto &e : entries) {
+      sim.process(e);
+    }
+  });
+}
+
+} // namespace
+
+#ifndef SIM_PROFILE
+// Every other form of new and delete forwards to these, so all of them are
+// counted and every pointer is released by the same free(). The compiler
+// must not see through the unsized delete: inlined, its free() trips
+// -Wmismatched-new-delete against the operator new it pairs with.
+void *operator new(size_t n) { return allocate(n, 0); }
+
+void *operator new(size_t n, std::align_val_t alignment) {
+  return allocate(n, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t n) { return ::operator new(n); }
+
+void *operator new[](size_t n, std::align_val_t alignment) {
+  return ::operator new(n, alignment);
+}
+
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { ::operator delete(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept {
+  ::operator delete(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  ::operator delete(p);
+}
+
+void operator delete[](void *p) noexcept { ::operator delete(p); }
+
+void operator delete[](void *p, size_t) noexcept { ::operator delete(p); }
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+  ::operator delete(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  ::operator delete(p);
+}
+#endif
+
+int main(int argc, char **argv) {
+  argparse::ArgumentParser program("bench");
+
+  program.add_argument("--ops")
+      .default_value(static_cast<uint64_t>(1000000))
+      .scan<'u', uint64_t>()
+      .help("operations per benchmark");
+  program.add_argument("--tmp-dir")
+      .default_value(std::filesystem::temp_directory_path().string())
+      .help("directory for the generated trace files");
+  program.add_argument("--trace")
+      .default_value("")
+      .help("also replay this trace through the simulator");
+  program.add_argument("--trace-format").default_value("csv");
+  program.add_argument("--dramsize")
+      .default_value(static_cast<uint64_t>(64 * 1024 * 1024))
+      .scan<'u', uint64_t>();
+  program.add_argument("--fifosize")
+      .default_value(static_cast<uint64_t>(1024 * 1024 * 1024))
+      .scan<'u', uint64_t>();
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::exception &err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << program;
+    std::exit(1);
+  }
+
+  const uint64_t numOps = program.get<uint64_t>("--ops");
+  if (numOps < 200000) {
+    std::cerr << "--ops must be at least 200000" << std::endl;
+    std::exit(1);
+  }
+
+  NullBuffer nullBuffer;
+  results.rdbuf(std::cout.rdbuf());
+  std::cout.rdbuf(&nullBuffer);
+
+  results << "benchmark,ops,ns_per_op,allocs_per_op,peak_rss_kb" << std::endl;
+  benchDramCache(numOps);
+  benchFifo(numOps);
+  benchTraceDecode(numOps, program.get<std::string>("--tmp-dir"));
+
+  if (const auto path = program.get<std::string>("--trace"); !path.empty()) {
+    auto format = parseTraceFormat(program.get<std::string>("--trace-format"));
+    if (!format) {
+      std::cerr << "Unknown trace format" << std::endl;
+      std::exit(1);
+    }
+    benchReplay(path, format.value(), program.get<uint64_t>("--dramsize"),
+                program.get<uint64_t>("--fifosize"));
+  }
+
+  std::cout.rdbuf(results.rdbuf());
+  return 0;
+}
@@ -1,107 +1,123 @@
 #include "fifo.h"
 #include <iostream>
+#include <stdexcept>
 
-#define ASSERT_WITH_MSG(expr, msg)                                             \
-  do {                                                                         \
-    if (!(expr)) {                                                             \
-      std::cout << "Assertion failed: " << msg << std::endl;                   \
-      assert(expr);                                                            \
-    }                                                                          \
-  } while (0)
+#include "SpecParser.h"
 
-std::vector<Fifo::Item> Fifo::insert(const DRAMCache::Item &dramItem) {
-  std::vector<Item> victims;
-  // This happens only when clear threshold is not 0.
-  if (segments[curSegmentPtr].isFull(dramItem.size)) {
-    curSegmentPtr = (curSegmentPtr + 1) % numTotalSegments;
-    rotationCounter += (curSegmentPtr == 0);
+template class FifoImpl<0, 0>;
+template class FifoImpl<256 * 1024, 4096>;
+template class FifoImpl<1024 * 1024, 4096>;
+template class FifoImpl<1024 * 1024, 16 * 1024>;
+template class FifoImpl<4 * 1024 * 1024, 16 * 1024>;
 
-    if (curSegmentPtr == 0) {
-      std::cout << fmt::format("Rotation count increases") << std::endl;
-    }
-
-    victims = segments[curSegmentPtr].clear();
-    for (auto &victim : victims) {
-      victim.rotationCounter = rotationCounter - 1;
-      overwrittenItems[victim.key] = victim;
-      keyToSegId.erase(victim.key);
-      ASSERT_WITH_MSG(victim.segId == curSegmentPtr,
-                      fmt::format("{}, {}", victim.segId, curSegmentPtr));
-      assert(keyToDramAccessCounter.contains(victim.key));
-      assert(keyToReuseDistance.contains(victim.key));
+namespace {
+constexpr std::string_view kSpecName = "write stream";
 
-      const auto &reuseHistory = keyToReuseDistance[victim.key];
-      uint32_t reuseHistorySize = reuseHistory.size();
-      uint32_t reuseDist = (reuseHistorySize == 1)
-                               ? 0
-                               : reuseHistory[reuseHistorySize - 1] -
-                                     reuseHistory[reuseHistorySize - 2];
+template <typename T>
+std::vector<T> parseList(std::string_view key, std::string_view s) {
+  std::vector<T> values;
+  while (!s.empty()) {
+    values.push_back(parseSpecNumber<T>(kSpecName, key, nextToken(s, ':')));
+  }
+  return values;
+}
 
-      overwrittenLogFile_ << fmt::format(
-                                 "{} {} {} {}",
-                                 getGlobalSegmentPtr(victim.rotationCounter,
-                                                     curSegmentPtr),
-                                 victim.numAccesses,
-                                 keyToDramAccessCounter[victim.key][0],
-                                 reuseDist)
-                          << std::endl;
+template <uint32_t kSegmentSize, uint32_t kPageSize>
+std::unique_ptr<Fifo> makeFifo(Stat &stat, const Clock &clock,
+                               uint64_t capacity,
+                               const std::string &overwrittenLogFile,
+                               const std::string &overwrittenAccessedLogFile,
+                               uint32_t segmentSize, uint32_t pageSize,
+                               std::pmr::memory_resource *historyMemory) {
+  return std::make_unique<FifoImpl<kSegmentSize, kPageSize>>(
+      stat, clock, capacity, overwrittenLogFile, overwrittenAccessedLogFile,
+      segmentSize, pageSize, historyMemory);
+}
+} // namespace
+
+FifoStreamConfig parseFifoStreamConfig(std::string_view spec) {
+  FifoStreamConfig config;
+  while (!spec.empty()) {
+    auto value = nextToken(spec, ',');
+    const auto key = nextToken(value, '=');
+    if (key == "by") {
+      if (value == "accesses") {
+        config.classifier = FifoStreamConfig::Classifier::kAccesses;
+      } else if (value == "size") {
+        config.classifier = FifoStreamConfig::Classifier::kSize;
+      } else if (value == "ttl") {
+        config.classifier = FifoStreamConfig::Classifier::kTtl;
+      } else {
+        throw std::invalid_argument(
+            fmt::format("Unknown write stream classifier: {}", value));
+      }
+    } else if (key == "bounds") {
+      config.bounds = parseList<uint64_t>(key, value);
+    } else if (key == "rotation") {
+      if (value == "shared") {
+        config.rotation = FifoStreamConfig::Rotation::kShared;
+      } else if (value == "independent") {
+        config.rotation = FifoStreamConfig::Rotation::kIndependent;
+      } else {
+        throw std::invalid_argument(
+            fmt::format("Unknown write stream rotation: {}", value));
+      }
+    } else if (key == "shares") {
+      config.shares = parseList<uint32_t>(key, value);
+    } else {
+      throw std::invalid_argument(
+          fmt::format("Unknown write stream parameter: {}", key));
     }
   }
 
-  keyToDramAccessCounter[dramItem.key].push_back(dramItem.numAccesses);
-  keyToReuseDistance[dramItem.key].push_back(
-      getGlobalSegmentPtr(rotationCounter, curSegmentPtr));
-
-  ASSERT_WITH_MSG(curSegmentPtr < numTotalSegments,
-                  fmt::format("{}, {}", curSegmentPtr, numTotalSegments));
-
-  remove(dramItem.key);
-  // Remove if key already exists
-  uint32_t pageId = segments[curSegmentPtr].insert(dramItem.key, dramItem.size);
-  keyToSegId[dramItem.key] = pageId;
-
-  return victims;
+  const auto &bounds = config.bounds;
+  if (std::adjacent_find(std::begin(bounds), std::end(bounds),
+                         std::greater_equal<>()) != std::end(bounds) ||
+      (!config.shares.empty() &&
+       (config.shares.size() != config.numStreams() ||
+        std::find(std::begin(config.shares), std::end(config.shares), 0) !=
+            std::end(config.shares)))) {
+    throw std::invalid_argument("Inconsistent write stream parameters");
+  }
+  return config;
 }
 
-std::optional<Fifo::Item> Fifo::lookup(const std::string &key) {
-  stat.numFifoAccesses++;
-
-  if (auto it = keyToSegId.find(key); it != std::end(keyToSegId)) {
-    stat.numFifoHits++;
-
-    uint32_t pageId = it->second;
-    uint32_t segId = pageId / numPagesPerSegment;
-    const auto item = segments[segId].lookup(key, pageId);
-    assert(item.has_value());
-    assert(keyToReuseDistance.contains(key));
-    keyToReuseDistance[key].push_back(
-        getGlobalSegmentPtr(rotationCounter, curSegmentPtr));
-    return item;
+std::unique_ptr<Fifo> Fifo::create(Stat &stat, const Clock &clock,
+                                   uint64_t capacity,
+                                   const std::string &overwrittenLogFile,
+                                   const std::string &overwrittenAccessedLogFile,
+                                   uint32_t segmentSize, uint32_t pageSize,
+                                   std::pmr::memory_resource *historyMemory) {
+  if (pageSize <= Item::kMetadataSize || segmentSize < pageSize ||
+      segmentSize % pageSize != 0) {
+    throw std::runtime_error(fmt::format(
+        "Invalid FIFO geometry: segment size {} must be a multiple of page "
+        "size {}",
+        segmentSize, pageSize));
   }
-
-  // This part is used for analytics
-  if (auto it = overwrittenItems.find(key); it != std::end(overwrittenItems)) {
-    stat.numFifoOverWrittenHits++;
-
-    const uint32_t segDist =
-        getGlobalSegmentPtr(rotationCounter, curSegmentPtr) -
-        getGlobalSegmentPtr(it->second.rotationCounter, it->second.segId);
-    const uint32_t numAccessesBefore = it->second.numAccesses;
-
-    overwrittenItems.erase(it);
-
-    overwrittenAccessedLogFile_
-        << fmt::format("{} {}", segDist, numAccessesBefore) << std::endl;
+  if (capacity / segmentSize == 0) {
+    throw std::runtime_error(
+        fmt::format("FIFO capacity {} is smaller than one segment ({})",
+                    capacity, segmentSize));
   }
 
-  return std::nullopt;
-}
-
-void Fifo::remove(const std::string &key) {
-  if (auto it = keyToSegId.find(key); it != std::end(keyToSegId)) {
-    uint32_t pageId = it->second;
-    uint32_t segId = pageId / numPagesPerSegment;
-    segments[segId].remove(key, pageId);
-    keyToSegId.erase(it);
+  std::cout << fmt::format("FIFO geometry: {} KB segments, {} KB pages",
+                           segmentSize / 1024, pageSize / 1024)
+            << std::endl;
+
+  constexpr uint32_t KB = 1024;
+  constexpr uint32_t MB = 1024 * 1024;
+  auto factory = makeFifo<0, 0>;
+  if (segmentSize == 256 * KB && pageSize == 4 * KB) {
+    factory = makeFifo<256 * KB, 4 * KB>;
+  } else if (segmentSize == 1 * MB && pageSize == 4 * KB) {
+    factory = makeFifo<1 * MB, 4 * KB>;
+  } else if (segmentSize == 1 * MB && pageSize == 16 * KB) {
+    factory = makeFifo<1 * MB, 16 * KB>;
+  } else if (segmentSize == 4 * MB && pageSize == 16 * KB) {
+    factory = makeFifo<4 * MB, 16 * KB>;
   }
+  return factory(stat, clock, capacity, overwrittenLogFile,
+                 overwrittenAccessedLogFile, segmentSize, pageSize,
+                 historyMemory);
 }
@@ -1,18 +1,72 @@
 #pragma once
 
+#include "Clock.h"
 #include "DRAMCache.h"
+#include "DiskHashMap.h"
+#include "FlashDevice.h"
+#include "FunctionRef.h"
+#include "IoEmulator.h"
+#include "MemoryResource.h"
+#include "Profile.h"
+#include "TagIndex.h"
+#include "TimerWheel.h"
 #include "stat.h"
 #include <cassert>
 #include <cstdint>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
 #include <numeric>
 #include <optional>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include "include/fmt/core.h"
 #include "include/robin_hood.h"
 
+#define ASSERT_WITH_MSG(expr, msg)                                             \
+  do {                                                                         \
+    if (!(expr)) {                                                             \
+      std::cout << "Assertion failed: " << msg << std::endl;                   \
+      assert(expr);                                                            \
+    }                                                                          \
+  } while (0)
+
+// Write streams of the FIFO, given on the command line as a comma-separated
+// spec, e.g.
+//   by=accesses,bounds=1:4,rotation=independent,shares=1:2:1
+// Each stream has its own open segment, so objects of different expected
+// lifetimes do not share segments.
+struct FifoStreamConfig {
+  enum class Classifier { kAccesses, kSize, kTtl };
+  // Shared: all streams take their next segment from one ring, in write
+  // order. Independent: each stream rotates through its own slice.
+  enum class Rotation { kShared, kIndependent };
+
+  // DRAM accesses, object size in bytes, or remaining TTL in seconds (no
+  // TTL counts as infinite).
+  Classifier classifier{Classifier::kAccesses};
+  // Stream i takes objects with bounds[i - 1] <= value < bounds[i]; the
+  // last stream takes the rest. Strictly increasing.
+  std::vector<uint64_t> bounds;
+  Rotation rotation{Rotation::kShared};
+  // Relative slice sizes of independent streams; empty: equal slices.
+  std::vector<uint32_t> shares;
+
+  uint32_t numStreams() const { return bounds.size() + 1; }
+};
+
+// Throws std::invalid_argument on unknown keys or malformed values.
+FifoStreamConfig parseFifoStreamConfig(std::string_view spec);
+
+// Log-structured flash tier. The segment and page sizes are chosen at run
+// time through Fifo::create(), which picks a FifoImpl instantiation with the
+// geometry baked in for the common sizes so that the page/segment index
+// arithmetic on the lookup path is constant-folded.
 class Fifo {
 public:
   struct Item {
@@ -21,36 +75,151 @@ public:
     uint32_t size{0};
     uint32_t numAccesses{0};
     uint32_t segId{0};
-    uint32_t rotationCounter{0};
+    uint32_t pageId{0};
+    uint32_t expiryTime{0};
     bool isErased{false};
 
     uint32_t getSize() const { return size + kMetadataSize; }
   };
 
-private:
+  static constexpr uint32_t kDefaultSegmentSize = 256 * 1024;
+  static constexpr uint32_t kDefaultPageSize = 4096;
+
+  static std::unique_ptr<Fifo>
+  create(Stat &stat, const Clock &clock, uint64_t capacity,
+         const std::string &overwrittenLogFile,
+         const std::string &overwrittenAccessedLogFile,
+         uint32_t segmentSize = kDefaultSegmentSize,
+         uint32_t pageSize = kDefaultPageSize,
+         std::pmr::memory_resource *historyMemory =
+             std::pmr::new_delete_resource());
+
+  // Receives each item overwritten when the write head reclaims a segment.
+  using VictimSink = FunctionRef<void(const Item &)>;
+
+  virtual ~Fifo() = default;
+
+  virtual void insert(const DRAMCache::Item &dramItem, VictimSink onVictim) = 0;
+
+  void insert(const DRAMCache::Item &dramItem) {
+    insert(dramItem, [](const Item &) {});
+  }
+
+  virtual std::optional<Fifo::Item> lookup(const std::string &key) = 0;
+
+  // Returns true if a live copy of key was dropped.
+  virtual bool remove(const std::string &key) = 0;
+
+  // Called with the segment id whenever the write head leaves a segment,
+  // i.e. when the segment is sealed and written to flash.
+  void setSegmentWriteHandler(std::function<void(uint32_t)> handler) {
+    segmentWriteHandler_ = std::move(handler);
+  }
+
+  // Called with the page id of every page a tag index lookup reads for an
+  // object of another key.
+  void setFalseReadHandler(std::function<void(uint32_t)> handler) {
+    falseReadHandler_ = std::move(handler);
+  }
+
+  // Drops expired items from the index in bulk. Their flash space is only
+  // reclaimed when the segment is overwritten, as for removed items.
+  void enableProactiveExpiry() { expiryWheel = std::make_unique<TimerWheel>(); }
+
+  virtual void expire() = 0;
+
+  // Models the DRAM index as partial-key tags (see TagIndexModel) next to
+  // the exact index. Call before the first insert.
+  virtual void enableTagIndex(const TagIndexConfig &config) = 0;
+
+  const TagIndexModel *getTagIndex() const { return tagIndex_.get(); }
+
+  // Objects currently reachable on flash, and their bytes.
+  virtual uint64_t getNumItems() const = 0;
+  virtual uint64_t getLiveBytes() const = 0;
+
+  virtual bool contains(const std::string &key) const = 0;
+
+  uint64_t getCapacity() const {
+    return uint64_t{numSegments_} * segmentSize_;
+  }
+
+  // Keeps the overwritten ghost and the per-key histories, which grow with
+  // every distinct key ever written, in scratch files under dir with
+  // hotBytes of each in DRAM. Only the fields the logs read are kept, in
+  // fixed-size records keyed by 64-bit key fingerprints. Call before the
+  // first insert.
+  virtual void enableOutOfCoreAnalytics(const std::filesystem::path &dir,
+                                        uint64_t hotBytes) = 0;
+
+  // Splits the write head into streams (see FifoStreamConfig). Call before
+  // the first insert.
+  virtual void enableWriteStreams(const FifoStreamConfig &config) = 0;
+
+  virtual uint32_t getNumStreams() const = 0;
+
+  // Writes, hits and overwritten objects per stream.
+  virtual void reportStreams(std::ostream &os) const = 0;
+
+  // Feeds sealed and reclaimed segments to a model of the device under
+  // the FIFO. Several models can run side by side. Call before the first
+  // insert.
+  virtual void addFlashDevice(const FlashDeviceConfig &config) = 0;
+
+  const std::vector<std::unique_ptr<FlashDevice>> &getFlashDevices() const {
+    return devices_;
+  }
+
+  // Writes items to a real file and reads back the page of every hit (see
+  // IoEmulator). Call before the first insert.
+  virtual void enableIoEmulation(const IoEmulationConfig &config) = 0;
+
+  IoEmulator *getIoEmulator() const { return ioEmulator_.get(); }
+
+  // Index, page maps, overwritten ghost and the per-key analytics maps.
+  virtual void appendMemoryUsage(std::vector<MemoryUsage> &usage) const = 0;
+
+  uint32_t getSegmentSize() const { return segmentSize_; }
+  uint32_t getPageSize() const { return pageSize_; }
+  uint32_t getNumPagesPerSegment() const { return segmentSize_ / pageSize_; }
+
+  // Largest object that fits in a single page.
+  uint32_t getMaxItemSize() const { return pageSize_ - Item::kMetadataSize; }
+
+protected:
+  // Segment and page clears hand out their items in place; the sink may
+  // move from them.
+  using ClearSink = FunctionRef<void(Item &)>;
+
   class Page {
   public:
-    static constexpr uint32_t kPageSize = 4096;
-
-    Page(uint32_t segId, uint32_t pageId)
-        : segId(segId), pageId(pageId), freeCapacity(kPageSize) {}
+    Page(uint32_t segId, uint32_t pageId, uint32_t pageSize)
+        : segId(segId), pageId(pageId), pageSize(pageSize),
+          freeCapacity(pageSize) {}
 
     bool isFull(uint32_t size) const {
       return freeCapacity < size + Fifo::Item::kMetadataSize;
     }
 
-    uint32_t insert(const std::string &key, uint32_t size) {
+    uint32_t insert(const std::string &key, uint32_t size,
+                    uint32_t expiryTime) {
       assert(freeCapacity >= size + Fifo::Item::kMetadataSize);
       freeCapacity -= (size + Fifo::Item::kMetadataSize);
       items[key] = {.key = key,
                     .size = size,
                     .numAccesses = 0,
                     .segId = segId,
-                    .rotationCounter = 0,
+                    .pageId = pageId,
+                    .expiryTime = expiryTime,
                     .isErased = false};
       return pageId;
     }
 
+    const Fifo::Item *find(const std::string &key) const {
+      auto it = items.find(key);
+      return it != std::end(items) ? &it->second : nullptr;
+    }
+
     std::optional<Fifo::Item> lookup(const std::string &key) {
       auto it = items.find(key);
       // TODO: it is guaranteed that item is in the page.
@@ -68,20 +237,28 @@ private:
       }
     }
 
-    void clear(std::vector<Fifo::Item> &victims) {
-      freeCapacity = kPageSize;
+    // Returns the number of items handed to onVictim.
+    uint32_t clear(ClearSink onVictim) {
+      freeCapacity = pageSize;
 
-      for (const auto &[key, item] : items) {
-        victims.push_back(item);
+      for (auto &[key, item] : items) {
+        onVictim(item);
       }
+      const uint32_t numItems = items.size();
       items.clear();
+      return numItems;
     }
 
     uint32_t getNumItems() const { return items.size(); }
 
+    void addMemoryUsage(MemoryUsage &usage) const {
+      addTableUsage(usage, items);
+    }
+
   private:
     const uint32_t segId;
     const uint32_t pageId;
+    const uint32_t pageSize;
     uint32_t freeCapacity;
 
     // This could be duplicated.
@@ -89,16 +266,18 @@ private:
     robin_hood::unordered_map<std::string, Fifo::Item> items;
   };
 
+  // Pages are addressed by their index within the segment; mapping global
+  // page ids to (segment, index) is left to FifoImpl, which knows the
+  // geometry at compile time where it can.
   class Segment {
   public:
-    static constexpr uint32_t kSegmentSize = 256 * 1024;
-
-    Segment(uint32_t segId) : segId_(segId), pageIdx_(0) {
-      const uint32_t numPagesPerSegment = kSegmentSize / Page::kPageSize;
+    Segment(uint32_t segId, uint32_t numPagesPerSegment, uint32_t pageSize)
+        : segId_(segId), pageIdx_(0) {
       uint32_t startPageId = segId * numPagesPerSegment;
       uint32_t endPageId = (segId + 1) * numPagesPerSegment;
+      pages_.reserve(numPagesPerSegment);
       for (uint32_t pageId = startPageId; pageId < endPageId; ++pageId) {
-        pages_.push_back({segId, pageId});
+        pages_.push_back({segId, pageId, pageSize});
       }
     }
 
@@ -107,59 +286,98 @@ private:
              (pageIdx_ == pages_.size() - 1 && pages_[pageIdx_].isFull(size));
     }
 
-    uint32_t insert(const std::string &key, uint32_t size) {
+    uint32_t insert(const std::string &key, uint32_t size,
+                    uint32_t expiryTime) {
       assert(pageIdx_ < pages_.size());
       if (pages_[pageIdx_].isFull(size)) {
         pageIdx_++;
       }
-      return pages_[pageIdx_].insert(key, size);
+      return pages_[pageIdx_].insert(key, size, expiryTime);
     }
 
-    std::optional<Fifo::Item> lookup(const std::string &key, uint32_t pageId) {
-      uint32_t targetPageIdx = pageId % (kSegmentSize / Page::kPageSize);
-      return pages_[targetPageIdx].lookup(key);
+    const Fifo::Item *find(const std::string &key,
+                           uint32_t targetPageIdx) const {
+      return pages_[targetPageIdx].find(key);
     }
 
-    std::vector<Fifo::Item> clear() {
-      uint32_t numVictims = std::accumulate(
-          std::begin(pages_), std::end(pages_), static_cast<uint32_t>(0),
-          [](uint32_t acc, const auto &page) {
-            return acc + page.getNumItems();
-          });
-      if (numVictims == 0) {
-        assert(pageIdx_ == 0);
-        return {};
-      }
+    std::optional<Fifo::Item> lookup(const std::string &key,
+                                     uint32_t targetPageIdx) {
+      return pages_[targetPageIdx].lookup(key);
+    }
 
-      std::vector<Fifo::Item> victims;
-      victims.reserve(numVictims);
+    // Returns the number of items handed to onVictim.
+    uint32_t clear(ClearSink onVictim) {
+      uint32_t numVictims = 0;
       for (uint32_t i = 0; i < pages_.size(); ++i) {
-        pages_[i].clear(victims);
+        numVictims += pages_[i].clear(onVictim);
       }
+      assert(numVictims > 0 || pageIdx_ == 0);
 
       pageIdx_ = 0;
-      return victims;
+      return numVictims;
     }
 
-    void remove(const std::string &key, uint32_t pageId) {
-      uint32_t targetPageIdx = pageId % (kSegmentSize / Page::kPageSize);
+    void remove(const std::string &key, uint32_t targetPageIdx) {
       assert(targetPageIdx < pages_.size());
       return pages_[targetPageIdx].remove(key);
     }
 
+    void addMemoryUsage(MemoryUsage &usage) const {
+      for (const auto &page : pages_) {
+        page.addMemoryUsage(usage);
+      }
+    }
+
   private:
     const uint32_t segId_;
     uint32_t pageIdx_;
     std::vector<Page> pages_;
   };
 
+  Fifo(uint32_t numSegments, uint32_t segmentSize, uint32_t pageSize)
+      : numSegments_(numSegments), segmentSize_(segmentSize),
+        pageSize_(pageSize) {}
+
+  std::function<void(uint32_t)> segmentWriteHandler_;
+  std::function<void(uint32_t)> falseReadHandler_;
+
+  std::unique_ptr<TimerWheel> expiryWheel;
+
+  std::unique_ptr<TagIndexModel> tagIndex_;
+
+  std::unique_ptr<IoEmulator> ioEmulator_;
+
+  std::vector<std::unique_ptr<FlashDevice>> devices_;
+
+private:
+  const uint32_t numSegments_;
+  const uint32_t segmentSize_;
+  const uint32_t pageSize_;
+};
+
+// kSegmentSize == kPageSize == 0 selects the generic instantiation, which
+// reads the geometry from the base class at run time.
+template <uint32_t kSegmentSize, uint32_t kPageSize>
+class FifoImpl final : public Fifo {
+  static_assert((kSegmentSize == 0) == (kPageSize == 0));
+  static_assert(kPageSize == 0 || kSegmentSize % kPageSize == 0);
+
 public:
-  Fifo(Stat &stat, uint64_t capacity, const std::string &overwrittenLogFile,
-       const std::string &overwrittenAccessedLogFile)
-      : stat(stat), numTotalSegments(capacity / Segment::kSegmentSize),
-        curSegmentPtr(0), rotationCounter(0) {
+  FifoImpl(Stat &stat, const Clock &clock, uint64_t capacity,
+           const std::string &overwrittenLogFile,
+           const std::string &overwrittenAccessedLogFile, uint32_t segmentSize,
+           uint32_t pageSize, std::pmr::memory_resource *historyMemory)
+      : Fifo(capacity / segmentSize, segmentSize, pageSize), stat(stat),
+        clock(clock),
+        numTotalSegments(capacity / segmentSize), curSegmentPtr(0),
+        rotationCounter(0), segmentOpenedAt_(numTotalSegments, 0),
+        segmentStream_(numTotalSegments, 0), historyMemory(historyMemory) {
+    assert(kSegmentSize == 0 ||
+           (segmentSize == kSegmentSize && pageSize == kPageSize));
+    streams_.push_back({.openSegment = 0, .begin = 0, .end = numTotalSegments});
+    segments.reserve(numTotalSegments);
     for (uint32_t i = 0; i < numTotalSegments; ++i) {
-      segments.push_back(i);
+      segments.emplace_back(i, numPagesPerSegment(), pageSize);
     }
     overwrittenLogFile_.open(overwrittenLogFile,
                              std::ios::out | std::ios::trunc);
@@ -174,40 +392,596 @@ public:
     }
   }
 
-  std::vector<Fifo::Item> insert(const DRAMCache::Item &dramItem);
+  using Fifo::insert;
+
+  void insert(const DRAMCache::Item &dramItem, VictimSink onVictim) override;
+
+  std::optional<Fifo::Item> lookup(const std::string &key) override;
+
+  bool remove(const std::string &key) override;
+
+  void expire() override;
+
+  void enableTagIndex(const TagIndexConfig &config) override {
+    assert(keyToSegId.empty());
+    tagIndex_ = std::make_unique<TagIndexModel>(
+        config, uint64_t{numTotalSegments} * numPagesPerSegment(),
+        getPageSize());
+  }
 
-  std::optional<Fifo::Item> lookup(const std::string &key);
+  uint64_t getNumItems() const override { return keyToSegId.size(); }
 
-  void remove(const std::string &key);
+  uint64_t getLiveBytes() const override { return liveBytes_; }
+
+  bool contains(const std::string &key) const override {
+    return keyToSegId.contains(key);
+  }
+
+  void enableOutOfCoreAnalytics(const std::filesystem::path &dir,
+                                uint64_t hotBytes) override {
+    assert(keyToDramAccessCounter.empty());
+    outOfCore_ = std::make_unique<OutOfCoreAnalytics>(dir, hotBytes);
+  }
+
+  void enableWriteStreams(const FifoStreamConfig &config) override;
+
+  uint32_t getNumStreams() const override { return streams_.size(); }
+
+  void reportStreams(std::ostream &os) const override;
+
+  void addFlashDevice(const FlashDeviceConfig &config) override {
+    assert(keyToSegId.empty() && segmentClock_ == 0);
+    devices_.push_back(
+        makeFlashDevice(config, numTotalSegments, getSegmentSize()));
+  }
+
+  void enableIoEmulation(const IoEmulationConfig &config) override {
+    assert(keyToSegId.empty() && segmentClock_ == 0);
+    ioEmulator_ = std::make_unique<IoEmulator>(
+        config, numTotalSegments, getSegmentSize(), getPageSize());
+  }
+
+  void appendMemoryUsage(std::vector<MemoryUsage> &usage) const override {
+    addTableUsage(usage.emplace_back(MemoryUsage{.table = "fifo.index"}),
+                  keyToSegId);
+    if (tagIndex_) {
+      tagIndex_->addMemoryUsage(
+          usage.emplace_back(MemoryUsage{.table = "fifo.tag-index"}));
+    }
+    auto &pages = usage.emplace_back(MemoryUsage{.table = "fifo.pages"});
+    for (const auto &segment : segments) {
+      segment.addMemoryUsage(pages);
+    }
+    if (expiryWheel) {
+      expiryWheel->addMemoryUsage(
+          usage.emplace_back(MemoryUsage{.table = "fifo.expiry-wheel"}));
+    }
+    if (outOfCore_) {
+      usage.push_back({.table = "fifo.overwritten"});
+      usage.push_back({.table = "fifo.overwritten.disk"});
+      outOfCore_->overwritten.addMemoryUsage(usage[usage.size() - 2],
+                                             usage.back());
+      usage.push_back({.table = "fifo.history"});
+      usage.push_back({.table = "fifo.history.disk"});
+      outOfCore_->histories.addMemoryUsage(usage[usage.size() - 2],
+                                           usage.back());
+      return;
+    }
+    addTableUsage(usage.emplace_back(MemoryUsage{.table = "fifo.overwritten"}),
+                  overwrittenItems);
+    auto &historyIndex =
+        usage.emplace_back(MemoryUsage{.table = "fifo.history.index"});
+    addTableUsage(historyIndex, keyToDramAccessCounter);
+    addTableUsage(historyIndex, keyToReuseDistance);
+    auto &histories = usage.emplace_back(MemoryUsage{.table = "fifo.history"});
+    addNestedVectorUsage(histories, keyToDramAccessCounter);
+    addNestedVectorUsage(histories, keyToReuseDistance);
+  }
 
 private:
   Stat &stat;
+  const Clock &clock;
   const uint32_t numTotalSegments;
-  const uint32_t numPagesPerSegment = Segment::kSegmentSize / Page::kPageSize;
   // const uint32_t reinsertionThreshold;
   // const uint32_t cleanThreshold;
 
   std::vector<Segment> segments;
+  // Last segment taken from the shared ring, and how often the ring wrapped.
   uint64_t curSegmentPtr;
 
   uint64_t rotationCounter;
 
+  struct Stream {
+    uint32_t openSegment;
+    // Slice of an independent stream: segments [begin, end).
+    uint32_t begin;
+    uint32_t end;
+    uint64_t numWrites{0};
+    uint64_t writeBytes{0};
+    uint64_t numHits{0};
+    uint64_t numReclaimedSegments{0};
+    // Objects neither removed nor expired when their segment was reclaimed.
+    uint64_t numOverwritten{0};
+    uint64_t overwrittenBytes{0};
+  };
+
+  FifoStreamConfig streamConfig_;
+  std::vector<Stream> streams_;
+
+  // Segments opened so far, not counting the first. Write and hit times in
+  // the histories and ghost ages are measured in it.
+  uint64_t segmentClock_{0};
+  // Segment clock when each segment was last opened, and by which stream.
+  std::vector<uint64_t> segmentOpenedAt_;
+  std::vector<uint32_t> segmentStream_;
+
   std::ofstream overwrittenLogFile_;
   std::ofstream overwrittenAccessedLogFile_;
 
   // key to access counter
   robin_hood::unordered_map<std::string, uint32_t> keyToSegId;
-  robin_hood::unordered_map<std::string, Item> overwrittenItems;
+  // Bytes of the objects keyToSegId points to.
+  uint64_t liveBytes_{0};
+  struct Ghost {
+    // Segment clock when the object's segment was opened.
+    uint64_t segPtr;
+    uint32_t numAccesses;
+  };
 
+  robin_hood::unordered_map<std::string, Ghost> overwrittenItems;
+
+  // Per-key histories grow with every write and hit; their buffers come
+  // from historyMemory.
+  std::pmr::memory_resource *historyMemory;
   // dram access count holder
-  robin_hood::unordered_map<std::string, std::vector<uint32_t>>
+  robin_hood::unordered_map<std::string, std::pmr::vector<uint32_t>>
       keyToDramAccessCounter;
   // flash access reuse distance
-  robin_hood::unordered_map<std::string, std::vector<uint64_t>>
+  robin_hood::unordered_map<std::string, std::pmr::vector<uint64_t>>
       keyToReuseDistance;
 
-  uint64_t getGlobalSegmentPtr(uint64_t rotationCounter,
-                               uint64_t localSegmentPtr) const {
-    return rotationCounter * numTotalSegments + localSegmentPtr;
+  // operator[] would default-construct a history on the default resource.
+  template <typename History>
+  History &historyOf(robin_hood::unordered_map<std::string, History> &map,
+                     const std::string &key) {
+    return map.try_emplace(key, historyMemory).first->second;
+  }
+
+  // Out-of-core replacement of the maps above.
+  struct KeyHistory {
+    // Last two entries of the reuse-distance history and its length.
+    uint64_t lastSegPtr;
+    uint64_t prevSegPtr;
+    uint32_t numSegPtrs;
+    // First entry of the DRAM access counter history.
+    uint32_t firstDramAccesses;
+  };
+
+  struct OutOfCoreAnalytics {
+    OutOfCoreAnalytics(const std::filesystem::path &dir, uint64_t hotBytes)
+        : histories(dir, hotBytes), overwritten(dir, hotBytes) {}
+
+    OutOfCoreMap<KeyHistory> histories;
+    OutOfCoreMap<Ghost> overwritten;
+  };
+
+  std::unique_ptr<OutOfCoreAnalytics> outOfCore_;
+
+  void recordWrite(const std::string &key, uint32_t dramAccesses,
+                   uint64_t segPtr) {
+    if (outOfCore_) {
+      auto &history = outOfCore_->histories[keyFingerprint(key)];
+      if (history.numSegPtrs == 0) {
+        history.firstDramAccesses = dramAccesses;
+      }
+      history.prevSegPtr = std::exchange(history.lastSegPtr, segPtr);
+      history.numSegPtrs++;
+      return;
+    }
+    historyOf(keyToDramAccessCounter, key).push_back(dramAccesses);
+    historyOf(keyToReuseDistance, key).push_back(segPtr);
+  }
+
+  void recordHit(const std::string &key, uint64_t segPtr) {
+    if (outOfCore_) {
+      auto *history = outOfCore_->histories.find(keyFingerprint(key));
+      assert(history != nullptr);
+      history->prevSegPtr = std::exchange(history->lastSegPtr, segPtr);
+      history->numSegPtrs++;
+      return;
+    }
+    assert(keyToReuseDistance.contains(key));
+    historyOf(keyToReuseDistance, key).push_back(segPtr);
+  }
+
+  // First DRAM access count of key and the distance between its last two
+  // flash events (0 if there was only one). Called for reclaimed objects,
+  // so an out-of-core history is only peeked at.
+  std::pair<uint32_t, uint32_t> historySummaryOf(const std::string &key) {
+    if (outOfCore_) {
+      const auto history = outOfCore_->histories.peek(keyFingerprint(key));
+      assert(history.has_value());
+      const uint32_t reuseDist = history->numSegPtrs == 1
+                                     ? 0
+                                     : history->lastSegPtr - history->prevSegPtr;
+      return {history->firstDramAccesses, reuseDist};
+    }
+    assert(keyToDramAccessCounter.contains(key));
+    assert(keyToReuseDistance.contains(key));
+
+    const auto &reuseHistory = keyToReuseDistance[key];
+    uint32_t reuseHistorySize = reuseHistory.size();
+    uint32_t reuseDist = (reuseHistorySize == 1)
+                             ? 0
+                             : reuseHistory[reuseHistorySize - 1] -
+                                   reuseHistory[reuseHistorySize - 2];
+    return {keyToDramAccessCounter[key][0], reuseDist};
+  }
+
+  void addGhost(std::string &&key, const Ghost &ghost) {
+    if (outOfCore_) {
+      outOfCore_->overwritten[keyFingerprint(key)] = ghost;
+      return;
+    }
+    overwrittenItems.insert_or_assign(std::move(key), ghost);
+  }
+
+  std::optional<Ghost> takeGhost(const std::string &key) {
+    if (outOfCore_) {
+      return outOfCore_->overwritten.take(keyFingerprint(key));
+    }
+    auto it = overwrittenItems.find(key);
+    if (it == std::end(overwrittenItems)) {
+      return std::nullopt;
+    }
+    const Ghost ghost = it->second;
+    overwrittenItems.erase(it);
+    return ghost;
+  }
+
+  // Every erase from keyToSegId goes through here to keep the tag index
+  // in step.
+  void unindex(const std::string &key) {
+    if (auto it = keyToSegId.find(key); it != std::end(keyToSegId)) {
+      unindex(it);
+    }
+  }
+
+  // Removed items stay in their page until it is cleared, so the size of
+  // what the index points to can still be looked up.
+  void unindex(decltype(keyToSegId)::iterator it) {
+    if (tagIndex_) {
+      tagIndex_->remove(it->first);
+    }
+    const uint32_t pageId = it->second;
+    const auto *item = segments[segIdOf(pageId)].find(it->first,
+                                                       pageIdxOf(pageId));
+    assert(item != nullptr);
+    liveBytes_ -= item->size;
+    keyToSegId.erase(it);
+  }
+
+  uint32_t numPagesPerSegment() const {
+    if constexpr (kSegmentSize != 0) {
+      return kSegmentSize / kPageSize;
+    } else {
+      return getNumPagesPerSegment();
+    }
+  }
+
+  uint32_t segIdOf(uint32_t pageId) const {
+    return pageId / numPagesPerSegment();
+  }
+
+  uint32_t pageIdxOf(uint32_t pageId) const {
+    return pageId % numPagesPerSegment();
+  }
+
+  uint32_t streamOf(const DRAMCache::Item &item) const {
+    if (streams_.size() == 1) {
+      return 0;
+    }
+    uint64_t value = 0;
+    switch (streamConfig_.classifier) {
+    case FifoStreamConfig::Classifier::kAccesses:
+      value = item.numAccesses;
+      break;
+    case FifoStreamConfig::Classifier::kSize:
+      value = item.size;
+      break;
+    case FifoStreamConfig::Classifier::kTtl:
+      value = item.expiryTime == 0
+                  ? UINT64_MAX
+                  : item.expiryTime - std::min(item.expiryTime, clock.nowSec());
+      break;
+    }
+    const auto &bounds = streamConfig_.bounds;
+    return std::upper_bound(std::begin(bounds), std::end(bounds), value) -
+           std::begin(bounds);
+  }
+
+  // Segment the write head of stream moves to when its open segment is
+  // full. The shared ring skips segments other streams still have open.
+  uint32_t nextSegment(const Stream &stream) {
+    if (streamConfig_.rotation == FifoStreamConfig::Rotation::kIndependent) {
+      uint32_t segId = stream.openSegment + 1;
+      if (segId == stream.end) {
+        segId = stream.begin;
+        std::cout << fmt::format("Rotation count increases (stream {})",
+                                 &stream - streams_.data())
+                  << std::endl;
+      }
+      return segId;
+    }
+    while (true) {
+      curSegmentPtr = (curSegmentPtr + 1) % numTotalSegments;
+      rotationCounter += (curSegmentPtr == 0);
+
+      if (curSegmentPtr == 0) {
+        std::cout << fmt::format("Rotation count increases") << std::endl;
+      }
+      if (std::none_of(std::begin(streams_), std::end(streams_),
+                       [&](const Stream &other) {
+                         return &other != &stream &&
+                                other.openSegment == curSegmentPtr;
+                       })) {
+        return curSegmentPtr;
+      }
+    }
   }
 };
+
+template <uint32_t kSegmentSize, uint32_t kPageSize>
+void FifoImpl<kSegmentSize, kPageSize>::insert(const DRAMCache::Item &dramItem,
+                                               VictimSink onVictim) {
+  PROFILE_SCOPE(kFifoInsert);
+  const uint32_t streamId = streamOf(dramItem);
+  Stream &stream = streams_[streamId];
+  // This happens only when clear threshold is not 0.
+  if (segments[stream.openSegment].isFull(dramItem.size)) {
+    PROFILE_SCOPE(kSegmentClear);
+    if (segmentWriteHandler_) {
+      segmentWriteHandler_(stream.openSegment);
+    }
+    if (ioEmulator_) {
+      ioEmulator_->seal(stream.openSegment);
+    }
+    for (auto &device : devices_) {
+      device->writeSegment(stream.openSegment, streamId);
+    }
+    const uint32_t segId = nextSegment(stream);
+    stream.openSegment = segId;
+    for (auto &device : devices_) {
+      device->trimSegment(segId);
+    }
+
+    // The victims were written by the stream that opened segId last time.
+    Stream &writer = streams_[segmentStream_[segId]];
+    const uint64_t writtenAt = segmentOpenedAt_[segId];
+    segmentOpenedAt_[segId] = ++segmentClock_;
+    segmentStream_[segId] = streamId;
+
+    const uint32_t numVictims =
+        segments[segId].clear([&](Item &victim) {
+          onVictim(victim);
+          // Erased copies were unindexed when they were erased, and the key
+          // may live on in a newer segment, so they are only dropped here.
+          if (victim.isErased) {
+            return;
+          }
+          if (clock.isExpired(victim.expiryTime)) {
+            // Expired in flash without being accessed: reclaimed by this
+            // clear.
+            stat.numFifoExpired++;
+            stat.fifoExpiredBytes += victim.size;
+            unindex(victim.key);
+            return;
+          }
+          unindex(victim.key);
+          ASSERT_WITH_MSG(victim.segId == segId,
+                          fmt::format("{}, {}", victim.segId, segId));
+          writer.numOverwritten++;
+          writer.overwrittenBytes += victim.size;
+          const auto [firstDramAccesses, reuseDist] =
+              historySummaryOf(victim.key);
+
+          overwrittenLogFile_ << writtenAt << ' ' << victim.numAccesses << ' '
+                              << firstDramAccesses << ' ' << reuseDist << '\n';
+
+          // The page is cleared right after, so the key can be moved.
+          addGhost(std::move(victim.key),
+                   {.segPtr = writtenAt, .numAccesses = victim.numAccesses});
+        });
+    writer.numReclaimedSegments += numVictims > 0;
+    PROFILE_COUNT(kSegmentClears, 1);
+    PROFILE_COUNT(kSegmentClearVictims, numVictims);
+    PROFILE_MAX(kMaxSegmentClearVictims, numVictims);
+  }
+
+  recordWrite(dramItem.key, dramItem.numAccesses, segmentClock_);
+
+  const uint32_t segId = stream.openSegment;
+  ASSERT_WITH_MSG(segId < numTotalSegments,
+                  fmt::format("{}, {}", segId, numTotalSegments));
+
+  stat.numFifoWrites++;
+  stat.fifoWriteBytes += dramItem.size + Item::kMetadataSize;
+  stream.numWrites++;
+  stream.writeBytes += dramItem.size + Item::kMetadataSize;
+
+  remove(dramItem.key);
+  // Remove if key already exists
+  uint32_t pageId = segments[segId].insert(
+      dramItem.key, dramItem.size, dramItem.expiryTime);
+  keyToSegId[dramItem.key] = pageId;
+  liveBytes_ += dramItem.size;
+  if (ioEmulator_) {
+    ioEmulator_->append(segId, pageIdxOf(pageId), dramItem.key, dramItem.size,
+                        dramItem.expiryTime);
+  }
+  if (tagIndex_) {
+    if (auto dropped = tagIndex_->insert(dramItem.key)) {
+      // Still on flash, but nothing points to it any more.
+      remove(*dropped);
+    }
+  }
+
+  if (expiryWheel && dramItem.expiryTime != 0) {
+    expiryWheel->schedule(dramItem.key, dramItem.expiryTime);
+  }
+}
+
+template <uint32_t kSegmentSize, uint32_t kPageSize>
+std::optional<Fifo::Item>
+FifoImpl<kSegmentSize, kPageSize>::lookup(const std::string &key) {
+  PROFILE_SCOPE(kFifoLookup);
+  stat.numFifoAccesses++;
+  if (tagIndex_) {
+    tagIndex_->lookup(key, [this](const std::string &other) {
+      if (auto it = keyToSegId.find(other);
+          falseReadHandler_ && it != std::end(keyToSegId)) {
+        falseReadHandler_(it->second);
+      }
+    });
+  }
+
+  if (auto it = keyToSegId.find(key); it != std::end(keyToSegId)) {
+    uint32_t pageId = it->second;
+    uint32_t segId = segIdOf(pageId);
+    const auto item = segments[segId].lookup(key, pageIdxOf(pageId));
+    assert(item.has_value());
+    if (clock.isExpired(item->expiryTime)) {
+      stat.numFifoExpired++;
+      stat.fifoExpiredBytes += item->size;
+      segments[segId].remove(key, pageIdxOf(pageId));
+      unindex(it);
+      return std::nullopt;
+    }
+
+    if (ioEmulator_) {
+      ioEmulator_->read(segId, pageIdxOf(pageId), key);
+    }
+    stat.numFifoHits++;
+    streams_[segmentStream_[segId]].numHits++;
+    recordHit(key, segmentClock_);
+    return item;
+  }
+
+  // This part is used for analytics
+  if (auto ghost = takeGhost(key)) {
+    stat.numFifoOverWrittenHits++;
+
+    const uint32_t segDist = segmentClock_ - ghost->segPtr;
+    const uint32_t numAccessesBefore = ghost->numAccesses;
+
+    overwrittenAccessedLogFile_
+        << fmt::format("{} {}", segDist, numAccessesBefore) << std::endl;
+  }
+
+  return std::nullopt;
+}
+
+template <uint32_t kSegmentSize, uint32_t kPageSize>
+bool FifoImpl<kSegmentSize, kPageSize>::remove(const std::string &key) {
+  if (auto it = keyToSegId.find(key); it != std::end(keyToSegId)) {
+    uint32_t pageId = it->second;
+    segments[segIdOf(pageId)].remove(key, pageIdxOf(pageId));
+    unindex(it);
+    return true;
+  }
+  return false;
+}
+
+template <uint32_t kSegmentSize, uint32_t kPageSize>
+void FifoImpl<kSegmentSize, kPageSize>::expire() {
+  if (!expiryWheel) {
+    return;
+  }
+  expiryWheel->advance(
+      clock.nowSec(), [this](const std::string &key, uint32_t expiryTime) {
+        auto it = keyToSegId.find(key);
+        if (it == std::end(keyToSegId)) {
+          return;
+        }
+        uint32_t pageId = it->second;
+        uint32_t segId = segIdOf(pageId);
+        const auto *item = segments[segId].find(key, pageIdxOf(pageId));
+        // Stale entry: the key was rewritten with a different expiry.
+        if (item == nullptr || item->expiryTime != expiryTime) {
+          return;
+        }
+        stat.numFifoExpired++;
+        stat.fifoExpiredBytes += item->size;
+        segments[segId].remove(key, pageIdxOf(pageId));
+        unindex(it);
+      });
+}
+
+template <uint32_t kSegmentSize, uint32_t kPageSize>
+void FifoImpl<kSegmentSize, kPageSize>::enableWriteStreams(
+    const FifoStreamConfig &config) {
+  assert(keyToSegId.empty() && segmentClock_ == 0);
+  const uint32_t numStreams = config.numStreams();
+  std::vector<Stream> streams;
+  if (config.rotation == FifoStreamConfig::Rotation::kIndependent) {
+    const uint64_t totalShares =
+        config.shares.empty()
+            ? numStreams
+            : std::accumulate(std::begin(config.shares),
+                              std::end(config.shares), uint64_t{0});
+    uint64_t sharesSoFar = 0;
+    for (uint32_t i = 0; i < numStreams; ++i) {
+      const uint32_t begin = sharesSoFar * numTotalSegments / totalShares;
+      sharesSoFar += config.shares.empty() ? 1 : config.shares[i];
+      const uint32_t end = sharesSoFar * numTotalSegments / totalShares;
+      if (begin == end) {
+        throw std::runtime_error(fmt::format(
+            "FIFO of {} segments is too small for the slice of stream {}",
+            numTotalSegments, i));
+      }
+      streams.push_back({.openSegment = begin, .begin = begin, .end = end});
+    }
+  } else {
+    if (numTotalSegments < numStreams) {
+      throw std::runtime_error(
+          fmt::format("FIFO of {} segments cannot hold {} open segments",
+                      numTotalSegments, numStreams));
+    }
+    for (uint32_t i = 0; i < numStreams; ++i) {
+      streams.push_back({.openSegment = i, .begin = 0, .end = numTotalSegments});
+    }
+    curSegmentPtr = numStreams - 1;
+  }
+
+  streamConfig_ = config;
+  streams_ = std::move(streams);
+  for (uint32_t i = 0; i < numStreams; ++i) {
+    const uint32_t segId = streams_[i].openSegment;
+    segmentOpenedAt_[segId] = i == 0 ? 0 : ++segmentClock_;
+    segmentStream_[segId] = i;
+  }
+}
+
+template <uint32_t kSegmentSize, uint32_t kPageSize>
+void FifoImpl<kSegmentSize, kPageSize>::reportStreams(std::ostream &os) const {
+  constexpr double MB = 1024 * 1024;
+  const auto &bounds = streamConfig_.bounds;
+  for (uint32_t i = 0; i < streams_.size(); ++i) {
+    const auto &stream = streams_[i];
+    const std::string range = fmt::format(
+        "[{}, {})", i == 0 ? 0 : bounds[i - 1],
+        i == bounds.size() ? "inf" : std::to_string(bounds[i]));
+    os << fmt::format("Stream {} {}: {} writes ({:.1f} MB), {} hits, {} "
+                      "segments reclaimed with {} live objects ({:.1f} MB)",
+                      i, range, stream.numWrites, stream.writeBytes / MB,
+                      stream.numHits, stream.numReclaimedSegments,
+                      stream.numOverwritten, stream.overwrittenBytes / MB)
+       << std::endl;
+  }
+}
+
+extern template class FifoImpl<0, 0>;
+extern template class FifoImpl<256 * 1024, 4096>;
+extern template class FifoImpl<1024 * 1024, 4096>;
+extern template class FifoImpl<1024 * 1024, 16 * 1024>;
+extern template class FifoImpl<4 * 1024 * 1024, 16 * 1024>;
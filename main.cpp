@@ -1,9 +1,17 @@
 #define FMT_HEADER_ONLY
 
+#include <cstdlib>
 #include <iostream>
 
+#include "Offline.h"
+#include "Profile.h"
+#include "ReuseDistance.h"
+#include "ShardedSim.h"
 #include "Sim.h"
+#include "SyntheticTrace.h"
+#include "TagIndex.h"
 #include "Trace.h"
+#include "WorkingSet.h"
 #include "include/argparse.h"
 #include "include/fmt/core.h"
 
@@ -13,6 +21,12 @@ double getMissRatio(const Stat &stat) {
   return static_cast<double>(numMisses) / stat.numAccesses * 100.0;
 }
 
+double getLargeMissRatio(const Stat &stat) {
+  uint64_t numMisses = stat.numLargeAccesses - stat.numLargeHits;
+
+  return static_cast<double>(numMisses) / stat.numLargeAccesses * 100.0;
+}
+
 double getOverwrittenHitRatio(const Stat &stat) {
   uint64_t numFifoMisses = stat.numFifoAccesses - stat.numFifoHits;
 
@@ -27,7 +41,12 @@ int main(int argc, char **argv) {
       .required()
       .nargs(argparse::nargs_pattern::any)
       .default_value("")
-      .help("target directory containing trace files");
+      .help("target directory containing trace files, or the workload "
+            "spec of a synthetic trace");
+  program.add_argument("--trace-format")
+      .default_value("csv")
+      .help("trace format: csv, twitter, oracleGeneral, kvcache or "
+            "synthetic");
   program.add_argument("-dsize", "--dramsize")
       .required()
       .scan<'u', uint64_t>();
@@ -44,6 +63,157 @@ int main(int argc, char **argv) {
   program.add_argument("-o", "--overwritten-acc-log")
       .default_value("./overwritten-acc.log")
       .help("output file");
+  program.add_argument("--ssd-sim")
+      .default_value(false)
+      .implicit_value(true)
+      .help("enable the discrete-event SSD queueing model");
+  program.add_argument("--ssd-channels")
+      .default_value(static_cast<uint32_t>(8))
+      .scan<'u', uint32_t>()
+      .help("number of flash channels in the SSD model");
+  program.add_argument("--ssd-read-us")
+      .default_value(static_cast<uint64_t>(80))
+      .scan<'u', uint64_t>()
+      .help("flash page read latency in microseconds");
+  program.add_argument("--ssd-program-us")
+      .default_value(static_cast<uint64_t>(600))
+      .scan<'u', uint64_t>()
+      .help("flash page program latency in microseconds");
+  program.add_argument("--request-rate")
+      .default_value(static_cast<uint64_t>(100000))
+      .scan<'u', uint64_t>()
+      .help("request arrival rate (requests/s) driving the simulated clock; "
+            "overrides trace timestamps when given");
+  program.add_argument("--segment-size")
+      .default_value(Fifo::kDefaultSegmentSize)
+      .scan<'u', uint32_t>()
+      .help("FIFO segment size in bytes");
+  program.add_argument("--page-size")
+      .default_value(Fifo::kDefaultPageSize)
+      .scan<'u', uint32_t>()
+      .help("FIFO page size in bytes");
+  program.add_argument("--large-cache-size")
+      .default_value(static_cast<uint64_t>(0))
+      .scan<'u', uint64_t>()
+      .help("capacity of the large-object flash engine (0: disabled, large "
+            "objects are skipped)");
+  program.add_argument("--large-threshold")
+      .default_value(static_cast<uint32_t>(2048))
+      .scan<'u', uint32_t>()
+      .help("objects above this size go to the large-object engine");
+  program.add_argument("--large-region-size")
+      .default_value(static_cast<uint32_t>(16 * 1024 * 1024))
+      .scan<'u', uint32_t>()
+      .help("region size of the large-object engine");
+  program.add_argument("--large-eviction")
+      .default_value("fifo")
+      .help("region eviction of the large-object engine: fifo or lru");
+  program.add_argument("--shards")
+      .default_value(static_cast<uint32_t>(1))
+      .scan<'u', uint32_t>()
+      .help("model a server sharded by key hash into this many independent "
+            "caches, each with 1/N of every capacity and its own thread");
+  program.add_argument("--shard-serial")
+      .default_value(false)
+      .implicit_value(true)
+      .help("replay all shards on the main thread (same results, no "
+            "threads)");
+  program.add_argument("--replay-sets")
+      .default_value(false)
+      .implicit_value(true)
+      .help("replay SET/REPLACE requests instead of skipping them");
+  program.add_argument("--write-through")
+      .default_value(false)
+      .implicit_value(true)
+      .help("write SET/REPLACE values through to flash");
+  program.add_argument("--write-trace")
+      .default_value("")
+      .help("write the (filtered) trace to this file in oracleGeneral "
+            "format instead of simulating");
+  program.add_argument("--offline-opt")
+      .default_value(false)
+      .implicit_value(true)
+      .help("replay with Belady's MIN in DRAM and oracle flash admission to "
+            "get an offline bound, instead of the online policies (not "
+            "with --large-cache-size)");
+  program.add_argument("--offline-dir")
+      .default_value(".")
+      .help("directory for the spill files of --offline-opt");
+  program.add_argument("--hot-keys")
+      .default_value(static_cast<uint32_t>(0))
+      .scan<'u', uint32_t>()
+      .help("print the top-K keys by accesses, bytes and FIFO overwritten "
+            "hits every stats interval (0: disabled)");
+  program.add_argument("--reuse-distance")
+      .default_value("")
+      .help("write exact reuse-distance histograms per op and size class to "
+            "this file (computed on a separate thread)");
+  program.add_argument("--flash-index")
+      .default_value("")
+      .help("model the flash DRAM index as partial-key tags, e.g. "
+            "\"tag-bits=12,slots=16,object-size=BYTES|buckets=N,"
+            "offset-bits=N,charge-dram\"; reports false-positive flash reads "
+            "(also issued to --ssd-sim) and DRAM bytes per object");
+  program.add_argument("--out-of-core-dir")
+      .default_value("")
+      .help("keep the FIFO overwritten ghost and per-key histories in "
+            "scratch files in this directory instead of in memory");
+  program.add_argument("--out-of-core-hot-mb")
+      .default_value(static_cast<uint64_t>(256))
+      .scan<'u', uint64_t>()
+      .help("DRAM for the hot entries of each out-of-core table, split "
+            "across shards");
+  program.add_argument("--write-streams")
+      .default_value("")
+      .help("split the FIFO write head into streams, e.g. "
+            "\"by=accesses|size|ttl,bounds=1:4,rotation=shared|independent,"
+            "shares=1:2:1\"; reports writes, hits and overwritten objects per "
+            "stream");
+  program.add_argument("--flash-device")
+      .nargs(argparse::nargs_pattern::any)
+      .default_value(std::vector<std::string>{})
+      .help("model the device under the FIFO and report its write "
+            "amplification; one or more of \"zns,zone-mb=N,max-open=N,"
+            "max-active=N,spare-zones=N\" and \"ftl,page-kb=N,block-kb=N,"
+            "op=PCT,trim\"");
+  program.add_argument("--io-emulation")
+      .default_value("")
+      .help("write FIFO segments to this file (O_DIRECT where supported) and "
+            "read back the page of every FIFO hit, reporting measured "
+            "throughput and latency");
+  program.add_argument("--io-backend")
+      .default_value("uring")
+      .help("I/O engine of --io-emulation: uring or threads");
+  program.add_argument("--hierarchy")
+      .default_value("inclusive")
+      .help("DRAM-FIFO hierarchy: inclusive (promoted FIFO hits keep their "
+            "flash copy) or exclusive (promotion moves them to DRAM and "
+            "eviction writes them back)");
+  program.add_argument("--promote-after-hits")
+      .default_value(static_cast<uint32_t>(1))
+      .scan<'u', uint32_t>()
+      .help("promote an object to DRAM on its N-th FIFO hit");
+  program.add_argument("--tier-report")
+      .default_value(false)
+      .implicit_value(true)
+      .help("print the bytes cached per tier every stats interval and at "
+            "the end");
+  program.add_argument("--huge-page-arena")
+      .default_value(false)
+      .implicit_value(true)
+      .help("allocate DRAM LRU nodes and FIFO per-key histories from 2 MB "
+            "huge-page arenas, and advise the malloc heap holding the hash "
+            "tables MADV_HUGEPAGE (glibc 2.35+)");
+  program.add_argument("--memory-report")
+      .default_value(false)
+      .implicit_value(true)
+      .help("print the estimated bytes and entries of every component and "
+            "the peak RSS every stats interval and at the end");
+  program.add_argument("--proactive-expiry")
+      .default_value(false)
+      .implicit_value(true)
+      .help("expire TTL items in bulk with a timer wheel instead of only on "
+            "access");
 
   try {
     program.parse_args(argc, argv);
@@ -52,52 +222,342 @@ int main(int argc, char **argv) {
     std::cerr << program;
     std::exit(1);
   }
+  if (program.get<bool>("--huge-page-arena")) {
+    adviseMallocHugePages(argv);
+  }
+
+  auto traceFormat =
+      parseTraceFormat(program.get<std::string>("--trace-format"));
+  if (!traceFormat) {
+    std::cerr << "Unknown trace format: "
+              << program.get<std::string>("--trace-format") << std::endl;
+    std::exit(1);
+  }
+  const uint64_t largeCacheSize = program.get<uint64_t>("--large-cache-size");
+  const uint32_t largeRegionSize = program.get<uint32_t>("--large-region-size");
+  const uint32_t largeThreshold = program.get<uint32_t>("--large-threshold");
+  const uint32_t pageSize = program.get<uint32_t>("--page-size");
+  if (largeCacheSize > 0 && largeRegionSize <= BlockCache::kMetadataSize) {
+    std::cerr << "--large-region-size is too small" << std::endl;
+    std::exit(1);
+  }
+  // OPT only models DRAM and the paged FIFO.
+  if (largeCacheSize > 0 && program.get<bool>("--offline-opt")) {
+    std::cerr << "--offline-opt does not model --large-cache-size"
+              << std::endl;
+    std::exit(1);
+  }
+  const auto largeEvictionName = program.get<std::string>("--large-eviction");
+  if (largeEvictionName != "fifo" && largeEvictionName != "lru") {
+    std::cerr << "Unknown --large-eviction: " << largeEvictionName
+              << std::endl;
+    std::exit(1);
+  }
+  const auto largeEviction = largeEvictionName == "lru"
+                                 ? BlockCache::EvictionPolicy::kLru
+                                 : BlockCache::EvictionPolicy::kFifo;
+  const uint32_t maxObjectSize =
+      largeCacheSize > 0 ? largeRegionSize - BlockCache::kMetadataSize
+                         : TraceReader::kDefaultMaxObjectSize;
+  // Every object the FIFO gets must fit in one of its pages.
+  const uint32_t maxFifoObjectSize =
+      largeCacheSize > 0 ? largeThreshold : maxObjectSize;
+  if (maxFifoObjectSize + Fifo::Item::kMetadataSize > pageSize) {
+    std::cerr << fmt::format("--page-size {} cannot hold the {} byte "
+                             "objects the FIFO may get, plus {} bytes of "
+                             "metadata",
+                             pageSize, maxFifoObjectSize,
+                             Fifo::Item::kMetadataSize)
+              << std::endl;
+    std::exit(1);
+  }
+
+  Trace trace(program.get<std::vector<std::string>>("--file"),
+              traceFormat.value(), program.get<bool>("--replay-sets"),
+              maxObjectSize);
+
+  if (const auto path = program.get<std::string>("--write-trace");
+      !path.empty()) {
+    const uint64_t numRecords = writeOracleGeneral(trace, path);
+    std::cout << fmt::format("Wrote {} records to {}", numRecords, path)
+              << std::endl;
+    return 0;
+  }
+
+  if (program.get<bool>("--offline-opt")) {
+    std::ofstream log(program.get<std::string>("--output"),
+                      std::ios::out | std::ios::trunc);
+    runOfflineOpt(trace,
+                  {.dramSize = program.get<uint64_t>("--dramsize"),
+                   .fifoSize = program.get<uint64_t>("--fifosize"),
+                   .segmentSize = program.get<uint32_t>("--segment-size"),
+                   .pageSize = pageSize,
+                   .overwrittenLog = program.get<std::string>("--overwritten-log"),
+                   .overwrittenAccLog =
+                       program.get<std::string>("--overwritten-acc-log"),
+                   .workDir = program.get<std::string>("--offline-dir"),
+                   .statPrintInterval = 500000},
+                  log);
+    return 0;
+  }
+
+  const uint64_t requestRate = program.get<uint64_t>("--request-rate");
+  if (requestRate == 0) {
+    std::cerr << "--request-rate must be positive" << std::endl;
+    std::exit(1);
+  }
+  const bool useTraceClock =
+      trace.hasTimestamps() && !program.is_used("--request-rate");
+  std::cout << (useTraceClock
+                    ? fmt::format("Clock: trace timestamps")
+                    : fmt::format("Clock: {} requests/s", requestRate))
+            << std::endl;
+
+  const uint32_t numShards = program.get<uint32_t>("--shards");
+  if (numShards == 0) {
+    std::cerr << "--shards must be positive" << std::endl;
+    std::exit(1);
+  }
+  const uint32_t ssdChannels = program.get<uint32_t>("--ssd-channels");
+  if (ssdChannels == 0) {
+    std::cerr << "--ssd-channels must be positive" << std::endl;
+    std::exit(1);
+  }
+  // The sketches track more counters than reported to keep the error of
+  // the reported keys small.
+  const uint32_t hotKeys = program.get<uint32_t>("--hot-keys");
+  constexpr uint32_t kHotKeySketchFactor = 16;
 
-  Trace trace(program.get<std::vector<std::string>>("--file"));
+  std::optional<TagIndexConfig> tagIndexConfig;
+  if (const auto spec = program.get<std::string>("--flash-index");
+      !spec.empty()) {
+    tagIndexConfig = parseTagIndexConfig(spec);
+  }
+
+  std::optional<FifoStreamConfig> streamConfig;
+  if (const auto spec = program.get<std::string>("--write-streams");
+      !spec.empty()) {
+    streamConfig = parseFifoStreamConfig(spec);
+  }
+
+  std::vector<FlashDeviceConfig> deviceConfigs;
+  for (const auto &spec :
+       program.get<std::vector<std::string>>("--flash-device")) {
+    deviceConfigs.push_back(parseFlashDeviceConfig(spec));
+  }
+
+  const auto ioBackendName = program.get<std::string>("--io-backend");
+  if (ioBackendName != "uring" && ioBackendName != "threads") {
+    std::cerr << "Unknown --io-backend: " << ioBackendName << std::endl;
+    std::exit(1);
+  }
+  const auto ioBackend = ioBackendName == "threads"
+                             ? IoEmulationConfig::Backend::kThreadPool
+                             : IoEmulationConfig::Backend::kIoUring;
+
+  const auto hierarchyName = program.get<std::string>("--hierarchy");
+  if (hierarchyName != "inclusive" && hierarchyName != "exclusive") {
+    std::cerr << "Unknown --hierarchy: " << hierarchyName << std::endl;
+    std::exit(1);
+  }
+  const auto hierarchy = hierarchyName == "exclusive" ? Hierarchy::kExclusive
+                                                      : Hierarchy::kInclusive;
 
-  Simulator sim(program.get<uint64_t>("--fifosize"),
-                program.get<std::string>("--overwritten-log"),
-                program.get<std::string>("--overwritten-acc-log"),
-                program.get<uint64_t>("--dramsize"));
+  // Each shard gets an equal slice of every capacity.
+  auto makeSimulator = [&](uint32_t shardId) {
+    const std::string suffix =
+        numShards > 1 ? fmt::format(".shard{}", shardId) : "";
+    auto sim = std::make_unique<Simulator>(
+        program.get<uint64_t>("--fifosize") / numShards,
+        program.get<std::string>("--overwritten-log") + suffix,
+        program.get<std::string>("--overwritten-acc-log") + suffix,
+        program.get<uint64_t>("--dramsize") / numShards,
+        program.get<uint32_t>("--segment-size"), pageSize,
+        program.get<bool>("--huge-page-arena"));
+
+    if (largeCacheSize > 0) {
+      sim->enableLargeObjectCache(largeCacheSize / numShards, largeRegionSize,
+                                  largeEviction, largeThreshold);
+    }
+    sim->setWriteThrough(program.get<bool>("--write-through"));
+    sim->setHierarchy(
+        hierarchy, std::max(1u, program.get<uint32_t>("--promote-after-hits")));
+    if (program.get<bool>("--proactive-expiry")) {
+      sim->enableProactiveExpiry();
+    }
+    if (tagIndexConfig) {
+      sim->enableTagIndex(*tagIndexConfig);
+    }
+    if (const auto dir = program.get<std::string>("--out-of-core-dir");
+        !dir.empty()) {
+      sim->enableOutOfCoreAnalytics(
+          dir, (program.get<uint64_t>("--out-of-core-hot-mb") << 20) /
+                   numShards);
+    }
+    if (streamConfig) {
+      sim->enableWriteStreams(*streamConfig);
+    }
+    for (const auto &config : deviceConfigs) {
+      sim->addFlashDevice(config);
+    }
+    if (const auto path = program.get<std::string>("--io-emulation");
+        !path.empty()) {
+      sim->enableIoEmulation({.path = path + suffix, .backend = ioBackend});
+    }
+    if (hotKeys > 0) {
+      sim->enableHotKeyTracking(hotKeys * kHotKeySketchFactor);
+    }
+    if (program.get<bool>("--ssd-sim")) {
+      sim->enableSsdQueueSim(
+          {.numChannels = ssdChannels,
+           .readLatencyNs = program.get<uint64_t>("--ssd-read-us") * 1000,
+           .programLatencyNs =
+               program.get<uint64_t>("--ssd-program-us") * 1000});
+    }
+    return sim;
+  };
+  ShardedSimulator sim(numShards, program.get<bool>("--shard-serial"),
+                       makeSimulator);
 
   std::ofstream log(program.get<std::string>("--output"),
                     std::ios::out | std::ios::trunc);
   log << fmt::format("numAccess,numHit,numDramAccess,numDramHit,"
-                     "numFifoAccess,numFifoHit,numFifoOverWrittenHits")
+                     "numFifoAccess,numFifoHit,numFifoOverWrittenHits,"
+                     "numDramExpired,numFifoExpired,numSet,"
+                     "numFifoInvalidation,numFifoWrite,fifoWriteBytes,"
+                     "numUpdateFlashWrite,updateFlashWriteBytes,"
+                     "numLargeAccess,numLargeHit,numLargeWrite,largeWriteBytes,"
+                     "numLargeRegionEviction,numLargeExpired,distinctKeys,"
+                     "distinctBytes")
       << std::endl;
 
+  const std::string reuseDistanceFile =
+      program.get<std::string>("--reuse-distance");
+  std::unique_ptr<ReuseDistanceAnalyzer> reuseDistance;
+  if (!reuseDistanceFile.empty()) {
+    reuseDistance = std::make_unique<ReuseDistanceAnalyzer>();
+  }
+
+  // Working set of the current stats interval (GETs and SETs).
+  WorkingSetEstimator workingSet;
+
+  const bool tierReport = program.get<bool>("--tier-report");
+  const bool memoryReport = program.get<bool>("--memory-report");
+  // Call right after sim.sync().
+  auto reportMemoryUsage = [&] {
+    std::vector<MemoryUsage> usage;
+    sim.appendMemoryUsage(usage);
+    trace.appendMemoryUsage(usage);
+    workingSet.addMemoryUsage(
+        usage.emplace_back(MemoryUsage{.table = "analytics.working-set"}));
+    if (reuseDistance) {
+      reuseDistance->appendMemoryUsage(usage);
+    }
+    printMemoryUsage(std::cout, usage);
+  };
+
   Trace::Entry e;
   const uint64_t statPrintInterval = 500000;
   Stat prevStat;
+  uint64_t numRequests = 0;
+  uint64_t numGets = 0;
+  // Non-GETs leave numGets on an interval boundary; report it only once.
+  std::optional<uint64_t> lastReportedGets;
+  std::optional<uint64_t> firstTimestamp;
+  const bool hasLargeObjectCache = largeCacheSize > 0;
   while (trace.nextRequest(e)) {
-    if (sim.getStat().numAccesses % statPrintInterval == 0) {
-      const auto &curStat = sim.getStat();
-      Stat mid = curStat - prevStat;
-      double missRatio = getMissRatio(mid);
-      double overwrittenHitRatio = getOverwrittenHitRatio(mid);
-
-      std::cout << fmt::format(
-                       "Miss ratio: {:.2f}, OverwrittenHitRatio: {:.2f}",
-                       missRatio, overwrittenHitRatio)
-                << std::endl;
-
-      log << fmt::format("{},{},{},{},{},{},{}", curStat.numAccesses,
-                         curStat.numHits, curStat.numDramAccesses,
-                         curStat.numDramHits, curStat.numFifoAccesses,
-                         curStat.numFifoHits, curStat.numFifoOverWrittenHits)
-          << std::endl;
-
-      prevStat = sim.getStat();
+    uint64_t nowNs;
+    if (useTraceClock) {
+      if (!firstTimestamp) {
+        firstTimestamp = e.timestamp;
+      }
+      uint64_t elapsed = e.timestamp - std::min(e.timestamp, *firstTimestamp);
+      nowNs = elapsed * 1'000'000'000;
+    } else {
+      // Split so that billions of requests do not overflow 64 bits.
+      nowNs = numRequests / requestRate * 1'000'000'000 +
+              numRequests % requestRate * 1'000'000'000 / requestRate;
     }
+    numRequests++;
+
+    // numGets equals Stat::numAccesses once the shards have caught up.
+    if (numGets % statPrintInterval == 0 && lastReportedGets != numGets) {
+      lastReportedGets = numGets;
+      const auto &curStat = sim.sync();
+      const double distinctKeys = workingSet.distinctKeys();
+      const double distinctBytes = workingSet.distinctBytes();
+      workingSet.reset();
+      {
+        PROFILE_SCOPE(kLogFormat);
+        Stat mid = curStat - prevStat;
+        double missRatio = getMissRatio(mid);
+        double overwrittenHitRatio = getOverwrittenHitRatio(mid);
 
-    if (!e.isGet) {
-      sim.remove(e.key);
-      continue;
+        std::cout << fmt::format(
+                         "Miss ratio: {:.2f}, OverwrittenHitRatio: {:.2f}, "
+                         "WorkingSet: {:.0f} keys, {:.2f} MB",
+                         missRatio, overwrittenHitRatio, distinctKeys,
+                         distinctBytes / 1024 / 1024)
+                  << (hasLargeObjectCache
+                          ? fmt::format(", LargeMissRatio: {:.2f}, "
+                                        "LargeRejected: {}",
+                                        getLargeMissRatio(mid),
+                                        mid.numLargeRejected)
+                          : "")
+                  << std::endl;
+
+        log << fmt::format(
+                   "{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},"
+                   "{},{},{:.0f},{:.0f}",
+                   curStat.numAccesses, curStat.numHits,
+                   curStat.numDramAccesses, curStat.numDramHits,
+                   curStat.numFifoAccesses, curStat.numFifoHits,
+                   curStat.numFifoOverWrittenHits,
+                   curStat.numDramExpired, curStat.numFifoExpired,
+                   curStat.numSets, curStat.numFifoInvalidations,
+                   curStat.numFifoWrites, curStat.fifoWriteBytes,
+                   curStat.numUpdateFlashWrites, curStat.updateFlashWriteBytes,
+                   curStat.numLargeAccesses, curStat.numLargeHits,
+                   curStat.numLargeWrites, curStat.largeWriteBytes,
+                   curStat.numLargeRegionEvictions, curStat.numLargeExpired,
+                   distinctKeys, distinctBytes)
+            << std::endl;
+      }
+
+      if (hotKeys > 0) {
+        sim.reportHotKeys(std::cout, hotKeys);
+      }
+      if (tierReport) {
+        printTierUsage(std::cout, sim.getTierUsage());
+      }
+      if (memoryReport) {
+        reportMemoryUsage();
+      }
+
+      prevStat = curStat;
+      PROFILE_REPORT(std::cout, false);
     }
 
-    if (!sim.lookup(e.key)) {
-      sim.insert(e.key, e.size);
+    numGets += (e.op == Op::kGet);
+    if (e.op != Op::kDelete) {
+      workingSet.access(e.key, e.size);
+    }
+    if (reuseDistance) {
+      reuseDistance->access(e);
     }
+    sim.process(e, nowNs);
+  }
+
+  sim.finish(std::cout);
+  if (tierReport) {
+    printTierUsage(std::cout, sim.getTierUsage());
+  }
+  if (memoryReport) {
+    reportMemoryUsage();
+  }
+  PROFILE_REPORT(std::cout, true);
+  if (reuseDistance) {
+    reuseDistance->finish(reuseDistanceFile, std::cout);
   }
 
   return 0;
@@ -15,6 +15,33 @@ struct Stat {
 
   uint64_t numRemoved{0};
 
+  uint64_t numSets{0};
+  // stale FIFO copies dropped because the key was overwritten
+  uint64_t numFifoInvalidations{0};
+
+  // all item writes into the FIFO, and the share caused by write-through
+  // of SET/REPLACE updates
+  uint64_t numFifoWrites{0};
+  uint64_t fifoWriteBytes{0};
+  uint64_t numUpdateFlashWrites{0};
+  uint64_t updateFlashWriteBytes{0};
+
+  // TTL expiry, lazy (on access) and proactive (timer wheel) combined
+  uint64_t numDramExpired{0};
+  uint64_t dramExpiredBytes{0};
+  uint64_t numFifoExpired{0};
+  uint64_t fifoExpiredBytes{0};
+  uint64_t numLargeExpired{0};
+  uint64_t largeExpiredBytes{0};
+
+  // large-object engine (BlockCache)
+  uint64_t numLargeAccesses{0};
+  uint64_t numLargeHits{0};
+  uint64_t numLargeWrites{0};
+  uint64_t largeWriteBytes{0};
+  uint64_t numLargeRegionEvictions{0};
+  uint64_t numLargeRejected{0};
+
   Stat operator-(const Stat &stat) const {
     return {numFifoAccesses - stat.numFifoAccesses,
             numFifoHits - stat.numFifoHits,
@@ -23,6 +50,53 @@ struct Stat {
             numDramHits - stat.numDramHits,
             numAccesses - stat.numAccesses,
             numHits - stat.numHits,
-            numRemoved - stat.numRemoved};
+            numRemoved - stat.numRemoved,
+            numSets - stat.numSets,
+            numFifoInvalidations - stat.numFifoInvalidations,
+            numFifoWrites - stat.numFifoWrites,
+            fifoWriteBytes - stat.fifoWriteBytes,
+            numUpdateFlashWrites - stat.numUpdateFlashWrites,
+            updateFlashWriteBytes - stat.updateFlashWriteBytes,
+            numDramExpired - stat.numDramExpired,
+            dramExpiredBytes - stat.dramExpiredBytes,
+            numFifoExpired - stat.numFifoExpired,
+            fifoExpiredBytes - stat.fifoExpiredBytes,
+            numLargeExpired - stat.numLargeExpired,
+            largeExpiredBytes - stat.largeExpiredBytes,
+            numLargeAccesses - stat.numLargeAccesses,
+            numLargeHits - stat.numLargeHits,
+            numLargeWrites - stat.numLargeWrites,
+            largeWriteBytes - stat.largeWriteBytes,
+            numLargeRegionEvictions - stat.numLargeRegionEvictions,
+            numLargeRejected - stat.numLargeRejected};
+  }
+
+  Stat operator+(const Stat &stat) const {
+    return {numFifoAccesses + stat.numFifoAccesses,
+            numFifoHits + stat.numFifoHits,
+            numFifoOverWrittenHits + stat.numFifoOverWrittenHits,
+            numDramAccesses + stat.numDramAccesses,
+            numDramHits + stat.numDramHits,
+            numAccesses + stat.numAccesses,
+            numHits + stat.numHits,
+            numRemoved + stat.numRemoved,
+            numSets + stat.numSets,
+            numFifoInvalidations + stat.numFifoInvalidations,
+            numFifoWrites + stat.numFifoWrites,
+            fifoWriteBytes + stat.fifoWriteBytes,
+            numUpdateFlashWrites + stat.numUpdateFlashWrites,
+            updateFlashWriteBytes + stat.updateFlashWriteBytes,
+            numDramExpired + stat.numDramExpired,
+            dramExpiredBytes + stat.dramExpiredBytes,
+            numFifoExpired + stat.numFifoExpired,
+            fifoExpiredBytes + stat.fifoExpiredBytes,
+            numLargeExpired + stat.numLargeExpired,
+            largeExpiredBytes + stat.largeExpiredBytes,
+            numLargeAccesses + stat.numLargeAccesses,
+            numLargeHits + stat.numLargeHits,
+            numLargeWrites + stat.numLargeWrites,
+            largeWriteBytes + stat.largeWriteBytes,
+            numLargeRegionEvictions + stat.numLargeRegionEvictions,
+            numLargeRejected + stat.numLargeRejected};
   }
 };